@@ -0,0 +1,150 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ccan/err/err.h>
+
+#include <penny/math.h>
+
+#include "arena.h"
+
+/* The smallest chunk allocated when an arena runs out */
+#define ARENA_CHUNK_MIN (64 * 1024)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;	/* of data */
+	size_t used;
+	char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static void new_chunk(struct arena *a, size_t bytes)
+{
+	struct arena_chunk *c;
+
+	if (bytes > SIZE_MAX - sizeof(*c))
+		errx(1, "arena chunk of %zu bytes is too large", bytes);
+	c = malloc(sizeof(*c) + bytes);
+	if (!c)
+		err(1, "alloc failure %zu", sizeof(*c) + bytes);
+	c->next = a->chunk;
+	c->size = bytes;
+	c->used = 0;
+	a->chunk = c;
+	a->last = NULL;
+}
+
+static size_t chunk_free(const struct arena_chunk *c)
+{
+	return c ? c->size - c->used : 0;
+}
+
+/* Make sure the current chunk has @bytes free, adding one of at least @min */
+static void make_room(struct arena *a, size_t bytes, size_t min)
+{
+	if (bytes > SIZE_MAX - ARENA_ALIGN)
+		errx(1, "arena allocation of %zu bytes is too large", bytes);
+	bytes = ALIGN(bytes, ARENA_ALIGN);
+	if (chunk_free(a->chunk) < bytes)
+		new_chunk(a, max(bytes, min));
+}
+
+void arena_reserve(struct arena *a, size_t bytes)
+{
+	make_room(a, bytes, 0);
+}
+
+void *arena_alloc(struct arena *a, size_t bytes)
+{
+	make_room(a, bytes, ARENA_CHUNK_MIN);
+
+	struct arena_chunk *c = a->chunk;
+	void *p = c->data + c->used;
+	c->used += ALIGN(bytes, ARENA_ALIGN);
+	a->last = p;
+	a->last_bytes = bytes;
+	return p;
+}
+
+void *arena_zalloc(struct arena *a, size_t bytes)
+{
+	return memset(arena_alloc(a, bytes), 0, bytes);
+}
+
+void *arena_realloc(struct arena *a, void *p, size_t old, size_t bytes)
+{
+	struct arena_chunk *c = a->chunk;
+
+	if (p && p == a->last && bytes <= SIZE_MAX - ARENA_ALIGN) {
+		size_t at = (char *)p - c->data;
+		if (ALIGN(bytes, ARENA_ALIGN) <= c->size - at) {
+			c->used = at + ALIGN(bytes, ARENA_ALIGN);
+			a->last_bytes = bytes;
+			return p;
+		}
+	}
+
+	void *np = arena_alloc(a, bytes);
+	if (p)
+		memcpy(np, p, min(old, bytes));
+	return np;
+}
+
+void arena_reset(struct arena *a)
+{
+	struct arena_chunk *c = a->chunk;
+
+	a->last = NULL;
+	a->last_bytes = 0;
+	if (!c)
+		return;
+
+	if (c->next) {
+		size_t total = arena_size(a);
+		arena_free(a);
+		new_chunk(a, total);
+		return;
+	}
+	c->used = 0;
+}
+
+void arena_free(struct arena *a)
+{
+	struct arena_chunk *c, *next;
+
+	for (c = a->chunk; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	arena_init(a);
+}
+
+size_t arena_size(const struct arena *a)
+{
+	const struct arena_chunk *c;
+	size_t n = 0;
+
+	for (c = a->chunk; c; c = c->next)
+		n += c->size;
+	return n;
+}
+
+size_t arena_used(const struct arena *a)
+{
+	const struct arena_chunk *c;
+	size_t n = 0;
+
+	for (c = a->chunk; c; c = c->next)
+		n += c->used;
+	return n;
+}
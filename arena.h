@@ -0,0 +1,59 @@
+#ifndef CATALOG_ARENA_H_
+#define CATALOG_ARENA_H_
+
+#include <stddef.h>
+
+/*
+ * A bump allocator. Allocations are carved from large chunks in order and
+ * are never freed on their own: the whole arena is either reset (keeping
+ * its memory for the next use) or freed at once. Allocation failures are
+ * fatal, as they are everywhere else in the model.
+ */
+struct arena_chunk;
+
+struct arena {
+	struct arena_chunk *chunk;	/* being filled; older ones follow */
+	void *last;			/* the latest allocation */
+	size_t last_bytes;
+};
+
+#define ARENA_ALIGN 16
+
+/* A zeroed struct arena is an empty one */
+static inline void arena_init(struct arena *a)
+{
+	a->chunk = NULL;
+	a->last = NULL;
+	a->last_bytes = 0;
+}
+
+/*
+ * Make room for @bytes more (in one or many allocations) in a single chunk.
+ * A chunk added for it is just that big, where one added by a plain
+ * allocation has some room to spare.
+ */
+void arena_reserve(struct arena *a, size_t bytes);
+
+void *arena_alloc(struct arena *a, size_t bytes);
+void *arena_zalloc(struct arena *a, size_t bytes);
+
+/*
+ * Resize @p (of @old bytes) to @bytes. The latest allocation is extended in
+ * place when its chunk has room; anything else is copied, leaving the old
+ * copy unused until the arena is reset.
+ */
+void *arena_realloc(struct arena *a, void *p, size_t old, size_t bytes);
+
+/*
+ * Forget every allocation but keep the memory. If the arena spilled into
+ * more than one chunk, they are replaced by a single one as large as all
+ * of them, so the next use of the same size needs no more.
+ */
+void arena_reset(struct arena *a);
+void arena_free(struct arena *a);
+
+/* Bytes held, and bytes allocated since the last reset */
+size_t arena_size(const struct arena *a);
+size_t arena_used(const struct arena *a);
+
+#endif
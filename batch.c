@@ -0,0 +1,230 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <ccan/err/err.h>
+
+#include <penny/math.h>
+
+#include "batch.h"
+
+static int list_push(struct batch_list *l, char *path)
+{
+	if (l->nr == l->alloc) {
+		size_t n = l->alloc ? l->alloc * 2 : 64;
+		char **np = realloc(l->paths, n * sizeof(*np));
+		if (!np)
+			return -1;
+		l->paths = np;
+		l->alloc = n;
+	}
+	l->paths[l->nr++] = path;
+	return 0;
+}
+
+static int dir_filter(const struct dirent *d)
+{
+	return d->d_name[0] != '.';
+}
+
+int batch_list_add(struct batch_list *l, const char *path)
+{
+	struct stat st;
+	struct dirent **ents;
+	int i, n;
+
+	if (stat(path, &st) || !S_ISDIR(st.st_mode)) {
+		char *p = strdup(path);
+		if (!p || list_push(l, p)) {
+			free(p);
+			return -1;
+		}
+		return 0;
+	}
+
+	n = scandir(path, &ents, dir_filter, alphasort);
+	if (n < 0)
+		return -1;
+
+	int r = 0;
+	for (i = 0; i < n; i++) {
+		char *p;
+		if (!r && asprintf(&p, "%s/%s", path, ents[i]->d_name) < 0)
+			r = -1;
+		else if (!r && (stat(p, &st) || S_ISDIR(st.st_mode)))
+			free(p);	/* only one level deep */
+		else if (!r && list_push(l, p)) {
+			free(p);
+			r = -1;
+		}
+		free(ents[i]);
+	}
+	free(ents);
+	return r;
+}
+
+int batch_list_add_from(struct batch_list *l, const char *file)
+{
+	FILE *f = strcmp(file, "-") ? fopen(file, "r") : stdin;
+	char *line = NULL;
+	size_t sz = 0;
+	ssize_t len;
+	int r = 0;
+
+	if (!f)
+		return -1;
+
+	while (!r && (len = getline(&line, &sz, f)) >= 0) {
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len)
+			r = batch_list_add(l, line);
+	}
+
+	free(line);
+	if (f != stdin)
+		fclose(f);
+	return r;
+}
+
+void batch_list_free(struct batch_list *l)
+{
+	size_t i;
+	for (i = 0; i < l->nr; i++)
+		free(l->paths[i]);
+	free(l->paths);
+	l->paths = NULL;
+	l->nr = l->alloc = 0;
+}
+
+struct batch_result {
+	char *buf;
+	size_t len;
+	int ret;
+	bool done;
+};
+
+struct batch {
+	struct batch_list *l;
+	batch_fn fn;
+	void *priv;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t next;	/* next path to hand to a worker */
+	size_t emit;	/* next path to be written out */
+	size_t window;	/* how far workers may run ahead of emit */
+	struct batch_result *res;
+};
+
+static void *batch_worker(void *arg)
+{
+	struct batch *b = arg;
+
+	pthread_mutex_lock(&b->lock);
+	while (b->next < b->l->nr) {
+		if (b->next >= b->emit + b->window) {
+			pthread_cond_wait(&b->cond, &b->lock);
+			continue;
+		}
+
+		size_t i = b->next++;
+		pthread_mutex_unlock(&b->lock);
+
+		struct batch_result r = { };
+		FILE *o = open_memstream(&r.buf, &r.len);
+		if (!o)
+			err(1, "could not allocate output buffer");
+		r.ret = b->fn(b->l->paths[i], o, b->priv);
+		fclose(o);
+
+		pthread_mutex_lock(&b->lock);
+		r.done = true;
+		b->res[i] = r;
+		pthread_cond_broadcast(&b->cond);
+	}
+	pthread_mutex_unlock(&b->lock);
+	return NULL;
+}
+
+size_t batch_run(struct batch_list *l, unsigned jobs, batch_fn fn, void *priv, FILE *out)
+{
+	struct batch b = {
+		.l = l,
+		.fn = fn,
+		.priv = priv,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+	size_t failed = 0;
+	unsigned i, started;
+
+	if (!l->nr)
+		return 0;
+
+	jobs = min(jobs, (unsigned)min(l->nr, (size_t)UINT_MAX));
+	b.window = (size_t)jobs * 4;
+	b.res = calloc(l->nr, sizeof(*b.res));
+	if (!b.res)
+		err(1, "alloc failure batch results");
+
+	pthread_t *threads = calloc(jobs, sizeof(*threads));
+	if (!threads)
+		err(1, "alloc failure batch threads");
+
+	for (started = 0; started < jobs; started++) {
+		int e = pthread_create(&threads[started], NULL, batch_worker, &b);
+		if (e) {
+			if (!started) {
+				errno = e;
+				err(1, "could not start any workers");
+			}
+			warnx("only started %u of %u workers", started, jobs);
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&b.lock);
+	while (b.emit < l->nr) {
+		struct batch_result *r = &b.res[b.emit];
+		if (!r->done) {
+			pthread_cond_wait(&b.cond, &b.lock);
+			continue;
+		}
+		pthread_mutex_unlock(&b.lock);
+
+		fwrite(r->buf, 1, r->len, out);
+		free(r->buf);
+		if (r->ret)
+			failed++;
+
+		pthread_mutex_lock(&b.lock);
+		b.emit++;
+		pthread_cond_broadcast(&b.cond);
+	}
+	pthread_mutex_unlock(&b.lock);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(b.res);
+	return failed;
+}
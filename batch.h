@@ -0,0 +1,36 @@
+#ifndef CATALOG_BATCH_H_
+#define CATALOG_BATCH_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* The catalogs to parse, in the order their output is to be emitted */
+struct batch_list {
+	char **paths;
+	size_t nr, alloc;
+};
+
+/*
+ * Add @path, or if it names a directory, each of its entries in name order.
+ * Returns 0, or -1 with errno set.
+ */
+int batch_list_add(struct batch_list *l, const char *path);
+
+/* Add each path (one per line) listed in @file ('-' is stdin) */
+int batch_list_add_from(struct batch_list *l, const char *file);
+void batch_list_free(struct batch_list *l);
+
+/*
+ * Called from a worker thread. Output for @path goes to @o, a private
+ * buffer. Return non-zero if @path failed.
+ */
+typedef int (*batch_fn)(const char *path, FILE *o, void *priv);
+
+/*
+ * Run @fn over every path in @l using up to @jobs threads. Each path's
+ * output is copied to @out in list order as soon as it and everything
+ * before it is done. Returns the number of paths that failed.
+ */
+size_t batch_run(struct batch_list *l, unsigned jobs, batch_fn fn, void *priv, FILE *out);
+
+#endif
@@ -0,0 +1,399 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ccan/pr_debug/pr_debug.h>
+#include <ccan/endian/endian.h>
+#include <ccan/array_size/array_size.h>
+#include <ccan/hash/hash.h>
+
+#include <penny/math.h>
+
+#include "catalog.h"
+#include "model.h"
+#include "cache.h"
+
+/*
+ * Cache files hold the model's tables verbatim, in native byte order. Bump
+ * CACHE_FORMAT whenever the layout of anything in model.h changes.
+ */
+#define CACHE_MAGIC "24x7mdl"
+#define CACHE_FORMAT 6
+#define CACHE_ENDIAN 0x01020304
+
+enum cache_table {
+	CACHE_SCHEMAS,
+	CACHE_FIELDS,
+	CACHE_GROUPS,
+#define C(type, name) CACHE_EVENT_##name,
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+	CACHE_STRTAB,
+	CACHE_STRS,
+	CACHE_NAME_DISP,
+	CACHE_NAME_SLOT,
+	CACHE_TERMS,
+	CACHE_POSTINGS,
+	CACHE_TABLE_COUNT
+};
+
+struct cache_table_desc {
+	uint64_t offs;
+	uint64_t count;
+	uint64_t size;	/* of each element */
+};
+
+struct cache_header {
+	char magic[8];
+	uint32_t format;
+	uint32_t endian;
+	struct catalog_cache_key key;
+	struct hv_24x7_catalog_page_0 p0;
+	struct cache_table_desc tables[CACHE_TABLE_COUNT];
+};
+
+void catalog_cache_key(const struct catalog *c, struct catalog_cache_key *key)
+{
+	const struct catalog_section *s[] = { &c->schema, &c->event, &c->group, &c->formula };
+	unsigned i;
+
+	memset(key, 0, sizeof(*key));
+	key->magic = be_to_cpu(c->p0->magic);
+	key->length = be_to_cpu(c->p0->length);
+	key->version = be_to_cpu(c->p0->version);
+	memcpy(key->build_time_stamp, c->p0->build_time_stamp, sizeof(key->build_time_stamp));
+
+	key->hash = hash64_stable((const uint8_t *)c->p0, CATALOG_PAGE_SIZE, 0);
+	for (i = 0; i < ARRAY_SIZE(s); i++)
+		key->hash = hash64_stable((const uint8_t *)s[i]->data, s[i]->bytes, key->hash);
+}
+
+static char *cache_path(const char *dir, const struct catalog_cache_key *key)
+{
+	char ts[sizeof(key->build_time_stamp) + 1];
+	unsigned i, j = 0;
+	char *p;
+
+	/* the time stamp is nul padded, and nothing stops it holding a '/' */
+	for (i = 0; i < sizeof(key->build_time_stamp); i++)
+		if (isalnum((unsigned char)key->build_time_stamp[i]))
+			ts[j++] = key->build_time_stamp[i];
+	ts[j] = '\0';
+
+	if (asprintf(&p, "%s/%08"PRIx32"-%"PRIu64"-%s-%"PRIu32"-%016"PRIx64".cache",
+			dir, key->magic, key->version, ts, key->length, key->hash) < 0)
+		return NULL;
+	return p;
+}
+
+static void table_set(struct cache_header *h, enum cache_table t, uint64_t *offs,
+		size_t count, size_t size)
+{
+	*offs = ALIGN(*offs, 8);
+	h->tables[t] = (struct cache_table_desc) { *offs, count, size };
+	*offs += count * size;
+}
+
+static const struct {
+	enum cache_table t;
+	size_t size;
+} table_sizes[] = {
+	{ CACHE_SCHEMAS, sizeof(struct catalog_schema) },
+	{ CACHE_FIELDS, sizeof(struct catalog_schema_field) },
+	{ CACHE_GROUPS, sizeof(struct catalog_group) },
+#define C(type, name) { CACHE_EVENT_##name, sizeof(type) },
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+	{ CACHE_STRTAB, 1 },
+	{ CACHE_STRS, sizeof(struct catalog_str) },
+	{ CACHE_NAME_DISP, sizeof(uint32_t) },
+	{ CACHE_NAME_SLOT, sizeof(uint32_t) },
+	{ CACHE_TERMS, sizeof(struct catalog_term) },
+	{ CACHE_POSTINGS, sizeof(struct catalog_posting) },
+};
+
+static bool str_is_valid(const struct catalog_model *m, catalog_str_id id)
+{
+	if (id >= m->nr_strs)
+		return false;
+	const struct catalog_str *s = &m->strs[id];
+	/* model_str() users may rely on the nul terminator */
+	return s->offs < m->strtab_len && s->len < m->strtab_len - s->offs
+		&& !m->strtab[s->offs + s->len];
+}
+
+/*
+ * The header only says the tables fit the file. Everything that indexes
+ * one table from another is checked too, so a damaged cache file is stale
+ * rather than a way to read past the mapping.
+ */
+static bool model_is_consistent(const struct catalog_model *m)
+{
+	const struct catalog_events *e = &m->events;
+	size_t i;
+
+	for (i = 0; i < m->nr_strs; i++)
+		if (!str_is_valid(m, i)) {
+			pr_debug(1, "cache string %zu is out of range", i);
+			return false;
+		}
+
+	for (i = 0; i < m->nr_schemas; i++) {
+		const struct catalog_schema *s = &m->schemas[i];
+		if (s->first_field > m->nr_fields || s->nr_fields > m->nr_fields - s->first_field) {
+			pr_debug(1, "cache schema %zu fields are out of range", i);
+			return false;
+		}
+	}
+
+	for (i = 0; i < m->nr_groups; i++)
+		if (!str_is_valid(m, m->groups[i].name) || !str_is_valid(m, m->groups[i].desc)) {
+			pr_debug(1, "cache group %zu strings are out of range", i);
+			return false;
+		}
+
+	for (i = 0; i < m->nr_events; i++) {
+		/* read as bytes: anything but 0 or 1 isn't a valid bool */
+		if (((const uint8_t *)e->skipped)[i] > 1
+				|| !str_is_valid(m, e->name[i])
+				|| !str_is_valid(m, e->desc[i])
+				|| !str_is_valid(m, e->long_desc[i])) {
+			pr_debug(1, "cache event %zu is malformed", i);
+			return false;
+		}
+	}
+
+	for (i = 0; i < m->nr_name_slot; i++)
+		if (m->name_slot[i] >= m->nr_events) {
+			pr_debug(1, "cache name slot %zu is out of range", i);
+			return false;
+		}
+
+	for (i = 0; i < m->nr_terms; i++) {
+		const struct catalog_term *t = &m->terms[i];
+		if (!str_is_valid(m, t->word) || t->first_posting > m->nr_postings
+				|| t->nr_postings > m->nr_postings - t->first_posting) {
+			pr_debug(1, "cache term %zu is out of range", i);
+			return false;
+		}
+	}
+
+	for (i = 0; i < m->nr_postings; i++) {
+		const struct catalog_posting *p = &m->postings[i];
+		if (p->row >= m->nr_events || p->field > CATALOG_TEXT_LONG_DESC) {
+			pr_debug(1, "cache posting %zu is out of range", i);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int catalog_cache_load(const char *dir, const struct catalog_cache_key *key,
+		struct catalog_model *m)
+{
+	struct stat st;
+	unsigned i;
+	char *path = cache_path(dir, key);
+	if (!path)
+		return -1;
+
+	int fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	void *map = MAP_FAILED;
+	if (!fstat(fd, &st) && (size_t)st.st_size >= sizeof(struct cache_header))
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	const struct cache_header *h = map;
+	if (memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic))
+			|| h->format != CACHE_FORMAT
+			|| h->endian != CACHE_ENDIAN
+			|| memcmp(&h->key, key, sizeof(*key))) {
+		pr_debug(1, "cache file is stale or foreign");
+		goto stale;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(table_sizes); i++) {
+		const struct cache_table_desc *d = &h->tables[table_sizes[i].t];
+		if (d->size != table_sizes[i].size
+				|| !IS_ALIGNED(d->offs, 8)
+				|| d->offs > (uint64_t)st.st_size
+				|| d->count > ((uint64_t)st.st_size - d->offs) / d->size) {
+			pr_debug(1, "cache table %u is malformed", i);
+			goto stale;
+		}
+	}
+
+#define C(type, name)							\
+	if (h->tables[CACHE_EVENT_##name].count != h->tables[CACHE_EVENT_index].count) { \
+		pr_debug(1, "cache event column " #name " is the wrong length"); \
+		goto stale;						\
+	}
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+
+	if (h->tables[CACHE_NAME_SLOT].count && !h->tables[CACHE_NAME_DISP].count) {
+		pr_debug(1, "cache name index has no buckets");
+		goto stale;
+	}
+
+	memset(m, 0, sizeof(*m));
+	m->p0 = h->p0;
+	m->map = map;
+	m->map_bytes = st.st_size;
+#define T(name, t) do {						\
+		m->name = map + h->tables[t].offs;		\
+		m->nr_##name = h->tables[t].count;		\
+	} while (0)
+	T(schemas, CACHE_SCHEMAS);
+	T(fields, CACHE_FIELDS);
+	T(groups, CACHE_GROUPS);
+	T(strs, CACHE_STRS);
+	T(name_disp, CACHE_NAME_DISP);
+	T(name_slot, CACHE_NAME_SLOT);
+	T(terms, CACHE_TERMS);
+	T(postings, CACHE_POSTINGS);
+#undef T
+#define C(type, name) m->events.name = map + h->tables[CACHE_EVENT_##name].offs;
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+	m->nr_events = h->tables[CACHE_EVENT_index].count;
+	m->strtab = map + h->tables[CACHE_STRTAB].offs;
+	m->strtab_len = h->tables[CACHE_STRTAB].count;
+	if (!model_is_consistent(m)) {
+		memset(m, 0, sizeof(*m));
+		goto stale;
+	}
+	return 0;
+
+stale:
+	munmap(map, st.st_size);
+	errno = ESTALE;
+	return -1;
+}
+
+static int write_at(int fd, const void *buf, size_t len, off_t offs)
+{
+	while (len) {
+		ssize_t r = pwrite(fd, buf, len, offs);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += r;
+		len -= r;
+		offs += r;
+	}
+	return 0;
+}
+
+int catalog_cache_store(const char *dir, const struct catalog_cache_key *key,
+		const struct catalog_model *m)
+{
+	struct cache_header h;
+	uint64_t offs = sizeof(h);
+	char *tmp, *path = cache_path(dir, key);
+	int e;
+
+	if (!path)
+		return -1;
+	if (asprintf(&tmp, "%s/.tmp-XXXXXX", dir) < 0) {
+		free(path);
+		return -1;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.format = CACHE_FORMAT;
+	h.endian = CACHE_ENDIAN;
+	h.key = *key;
+	h.p0 = m->p0;
+	table_set(&h, CACHE_SCHEMAS, &offs, m->nr_schemas, sizeof(*m->schemas));
+	table_set(&h, CACHE_FIELDS, &offs, m->nr_fields, sizeof(*m->fields));
+	table_set(&h, CACHE_GROUPS, &offs, m->nr_groups, sizeof(*m->groups));
+#define C(type, name) table_set(&h, CACHE_EVENT_##name, &offs, m->nr_events, sizeof(type));
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+	table_set(&h, CACHE_STRTAB, &offs, m->strtab_len, 1);
+	table_set(&h, CACHE_STRS, &offs, m->nr_strs, sizeof(*m->strs));
+	table_set(&h, CACHE_NAME_DISP, &offs, m->nr_name_disp, sizeof(*m->name_disp));
+	table_set(&h, CACHE_NAME_SLOT, &offs, m->nr_name_slot, sizeof(*m->name_slot));
+	table_set(&h, CACHE_TERMS, &offs, m->nr_terms, sizeof(*m->terms));
+	table_set(&h, CACHE_POSTINGS, &offs, m->nr_postings, sizeof(*m->postings));
+
+	/* write to a temporary and rename() so readers never see a partial file */
+	int fd = mkstemp(tmp);
+	if (fd < 0)
+		goto err;
+	fchmod(fd, 0644);
+
+#define W(buf, t) write_at(fd, buf, h.tables[t].count * h.tables[t].size, h.tables[t].offs)
+#define C(type, name) || W(m->events.name, CACHE_EVENT_##name)
+	if (write_at(fd, &h, sizeof(h), 0)
+			|| W(m->schemas, CACHE_SCHEMAS)
+			|| W(m->fields, CACHE_FIELDS)
+			|| W(m->groups, CACHE_GROUPS)
+			CATALOG_EVENT_COLUMNS(C)
+			|| W(m->strtab, CACHE_STRTAB)
+			|| W(m->strs, CACHE_STRS)
+			|| W(m->name_disp, CACHE_NAME_DISP)
+			|| W(m->name_slot, CACHE_NAME_SLOT)
+			|| W(m->terms, CACHE_TERMS)
+			|| W(m->postings, CACHE_POSTINGS)
+			|| ftruncate(fd, offs)) {
+		e = errno;
+		close(fd);
+		goto err_unlink;
+	}
+#undef C
+#undef W
+
+	if (close(fd)) {
+		e = errno;
+		goto err_unlink;
+	}
+
+	if (rename(tmp, path)) {
+		e = errno;
+		goto err_unlink;
+	}
+
+	free(tmp);
+	free(path);
+	return 0;
+
+err_unlink:
+	unlink(tmp);
+	errno = e;
+err:
+	e = errno;
+	free(tmp);
+	free(path);
+	errno = e;
+	return -1;
+}
@@ -0,0 +1,37 @@
+#ifndef CATALOG_CACHE_H_
+#define CATALOG_CACHE_H_
+
+#include <stdint.h>
+
+struct catalog;
+struct catalog_model;
+
+/*
+ * Identifies the catalog a cache file was built from. The content hash
+ * covers page 0 and every section, so a rebuilt catalog that kept its
+ * version and time stamp still misses.
+ */
+struct catalog_cache_key {
+	uint32_t magic;
+	uint32_t length;
+	uint64_t version;
+	char build_time_stamp[16];
+	uint64_t hash;
+};
+
+void catalog_cache_key(const struct catalog *c, struct catalog_cache_key *key);
+
+/*
+ * Map the decoded model for @key from the cache in @dir. The model's tables
+ * point into the read-only mapping until model_free().
+ *
+ * Returns 0 on a hit, -1 (with errno set) on a miss or stale/foreign file.
+ */
+int catalog_cache_load(const char *dir, const struct catalog_cache_key *key,
+		struct catalog_model *m);
+
+/* Write @m to the cache in @dir. Returns 0, or -1 with errno set. */
+int catalog_cache_store(const char *dir, const struct catalog_cache_key *key,
+		const struct catalog_model *m);
+
+#endif
@@ -0,0 +1,534 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <ccan/pr_debug/pr_debug.h>
+#include <ccan/endian/endian.h>
+#include <ccan/array_size/array_size.h>
+
+#include <penny/math.h>
+
+#define __packed __attribute__((__packed__))
+#include "hv-24x7-catalog.h"
+#include "catalog.h"
+
+/*
+ * read() until @len bytes have been read or EOF. sysfs binary attributes
+ * hand data back a page at a time, so short reads are expected.
+ */
+static ssize_t read_full(int fd, void *buf, size_t len)
+{
+	size_t got = 0;
+	while (got < len) {
+		ssize_t r = read(fd, buf + got, len - got);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (!r)
+			break;
+		got += r;
+	}
+	return got;
+}
+
+/*
+ * Like read_full(), but scatters into @iov. Reads from @offs with preadv(),
+ * or from the current file position when @offs is negative.
+ */
+static ssize_t readv_full(int fd, struct iovec *iov, int iovcnt, off_t offs)
+{
+	size_t got = 0;
+	while (iovcnt) {
+		ssize_t r;
+		if (offs < 0)
+			r = readv(fd, iov, iovcnt);
+		else
+			r = preadv(fd, iov, iovcnt, offs + got);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (!r)
+			break;
+		got += r;
+
+		while (iovcnt && (size_t)r >= iov->iov_len) {
+			r -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt) {
+			iov->iov_base += r;
+			iov->iov_len -= r;
+		}
+	}
+	return got;
+}
+
+int catalog_read_page0(int fd, void *page0)
+{
+	ssize_t got = read_full(fd, page0, CATALOG_PAGE_SIZE);
+	if (got != CATALOG_PAGE_SIZE) {
+		pr_debug(1, "could not read page 0, got %zd bytes", got);
+		if (got >= 0)
+			errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+struct page_range {
+	unsigned page, pages;
+};
+
+bool catalog_page0_is_valid(const struct hv_24x7_catalog_page_0 *p0)
+{
+	unsigned length = be_to_cpu(p0->length);
+	if (be_to_cpu(p0->magic) != HV_24X7_CATALOG_MAGIC) {
+		pr_debug(1, "bad magic 0x%08x", be_to_cpu(p0->magic));
+		return false;
+	}
+
+	if (!length) {
+		pr_debug(1, "catalog has no pages");
+		return false;
+	}
+
+#define CHECK(n) do {								\
+		unsigned offs = be_to_cpu(p0->n##_data_offs);			\
+		unsigned len = be_to_cpu(p0->n##_data_len);			\
+		if (len && (!offs || offs + len > length)) {			\
+			pr_debug(1, #n " section (pages %u..%u) is outside the catalog (%u pages)", \
+					offs, offs + len, length);		\
+			return false;						\
+		}								\
+	} while (0)
+	CHECK(schema);
+	CHECK(event);
+	CHECK(group);
+	CHECK(formula);
+#undef CHECK
+
+	return true;
+}
+
+static int page_range_cmp(const void *a_, const void *b_)
+{
+	const struct page_range *a = a_, *b = b_;
+	if (a->page != b->page)
+		return a->page < b->page ? -1 : 1;
+	return 0;
+}
+
+/* The page range of each section in @sections, indexed by catalog_section_id */
+static void section_ranges(const struct hv_24x7_catalog_page_0 *p0, unsigned sections,
+		struct page_range r[CATALOG_SECTION_COUNT])
+{
+#define RANGE(id, n) r[id] = (struct page_range) { be_to_cpu(p0->n##_data_offs), be_to_cpu(p0->n##_data_len) }
+	RANGE(CATALOG_SCHEMA, schema);
+	RANGE(CATALOG_EVENT, event);
+	RANGE(CATALOG_GROUP, group);
+	RANGE(CATALOG_FORMULA, formula);
+#undef RANGE
+
+	unsigned id;
+	for (id = 0; id < CATALOG_SECTION_COUNT; id++)
+		if (!(sections & CATALOG_SECTION_BIT(id)))
+			r[id].pages = 0;
+}
+
+/*
+ * Sort @r and merge overlapping or adjacent ranges, dropping empty ones.
+ * Returns the number of ranges remaining.
+ */
+static unsigned page_ranges_merge(struct page_range *r, unsigned n)
+{
+	unsigned i, o = 0;
+	qsort(r, n, sizeof(*r), page_range_cmp);
+	for (i = 0; i < n; i++) {
+		if (!r[i].pages)
+			continue;
+		if (o && r[i].page <= r[o - 1].page + r[o - 1].pages) {
+			unsigned end = max(r[o - 1].page + r[o - 1].pages,
+					r[i].page + r[i].pages);
+			r[o - 1].pages = end - r[o - 1].page;
+			continue;
+		}
+		r[o++] = r[i];
+	}
+	return o;
+}
+
+/*
+ * For sources we can't map: read page 0 to learn where the sections live,
+ * then fetch the ones in @sections with a single vectored read into one page aligned
+ * buffer. Pages that lie between sections are read into a scratch buffer
+ * and dropped.
+ */
+static int catalog_read(struct catalog *c, int fd, unsigned sections)
+{
+	struct hv_24x7_catalog_page_0 p0;
+	struct page_range r[CATALOG_SECTION_COUNT];
+	struct iovec iov[2 * ARRAY_SIZE(r)];
+	void *buf = NULL, *scratch = NULL;
+	unsigned i, n, iovcnt = 0;
+	size_t pages = 0, gap = 0;
+	ssize_t got;
+	int e;
+
+	char page0[CATALOG_PAGE_SIZE];
+	if (catalog_read_page0(fd, page0))
+		return -1;
+	memcpy(&p0, page0, sizeof(p0));
+
+	section_ranges(&p0, sections, r);
+	n = page_ranges_merge(r, ARRAY_SIZE(r));
+	/* page 0 is already in hand */
+	if (n && r[0].page == 0) {
+		r[0].page++;
+		r[0].pages--;
+	}
+
+	unsigned next = 1;
+	for (i = 0; i < n; i++) {
+		pages += r[i].pages;
+		gap = max(gap, (size_t)(r[i].page - next));
+		next = r[i].page + r[i].pages;
+	}
+
+	e = posix_memalign(&buf, CATALOG_PAGE_SIZE, (1 + pages) * CATALOG_PAGE_SIZE);
+	if (e) {
+		errno = e;
+		return -1;
+	}
+	memcpy(buf, page0, CATALOG_PAGE_SIZE);
+
+	if (gap) {
+		scratch = malloc(gap * CATALOG_PAGE_SIZE);
+		if (!scratch)
+			goto err;
+	}
+
+	/*
+	 * iov covers every page from 1 up to the end of the last run, so that
+	 * it can also be used with readv() on sources that can't seek.
+	 */
+	bool lead = n && r[0].page > 1;
+	size_t lead_bytes = lead ? (size_t)(r[0].page - 1) * CATALOG_PAGE_SIZE : 0;
+	void *p = buf + CATALOG_PAGE_SIZE;
+	next = 1;
+	for (i = 0; i < n; i++) {
+		if (r[i].page != next)
+			iov[iovcnt++] = (struct iovec) {
+				scratch, (size_t)(r[i].page - next) * CATALOG_PAGE_SIZE
+			};
+		iov[iovcnt++] = (struct iovec) { p, (size_t)r[i].pages * CATALOG_PAGE_SIZE };
+		p += (size_t)r[i].pages * CATALOG_PAGE_SIZE;
+		next = r[i].page + r[i].pages;
+	}
+
+	got = 0;
+	if (n) {
+		got = readv_full(fd, iov + lead, iovcnt - lead,
+				(off_t)r[0].page * CATALOG_PAGE_SIZE);
+		if (got < 0 && errno == ESPIPE) {
+			got = readv_full(fd, iov, iovcnt, -1);
+			if (got >= 0)
+				got -= min((size_t)got, lead_bytes);
+		}
+		if (got < 0)
+			goto err;
+	}
+	free(scratch);
+	scratch = NULL;
+
+	c->base = buf;
+	c->bytes = (1 + pages) * CATALOG_PAGE_SIZE;
+	c->mapped = false;
+
+	c->extents[0] = (struct catalog_extent) { 0, 1, buf };
+	c->nr_extents = 1;
+	p = buf + CATALOG_PAGE_SIZE;
+	for (i = 0; i < n; i++) {
+		size_t have = min((size_t)got / CATALOG_PAGE_SIZE, (size_t)r[i].pages);
+		c->extents[c->nr_extents++] = (struct catalog_extent) { r[i].page, have, p };
+		p += (size_t)r[i].pages * CATALOG_PAGE_SIZE;
+		got -= have * CATALOG_PAGE_SIZE;
+		/* gaps between runs were read too */
+		if (i + 1 < n)
+			got -= min((size_t)got, (size_t)(r[i + 1].page - r[i].page - r[i].pages) * CATALOG_PAGE_SIZE);
+	}
+
+	return 0;
+
+err:
+	e = errno;
+	free(scratch);
+	free(buf);
+	errno = e;
+	return -1;
+}
+
+static int catalog_map(struct catalog *c, int fd, size_t bytes)
+{
+	void *m = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (m == MAP_FAILED)
+		return -1;
+
+	c->base = m;
+	c->bytes = bytes;
+	c->mapped = true;
+	c->extents[0] = (struct catalog_extent) { 0, bytes / CATALOG_PAGE_SIZE, m };
+	c->nr_extents = 1;
+	return 0;
+}
+
+/* Locate pages [@page, @page + @pages) in whichever extent holds them */
+static void *catalog_pages(struct catalog *c, unsigned page, unsigned pages)
+{
+	unsigned i;
+	for (i = 0; i < c->nr_extents; i++) {
+		struct catalog_extent *e = &c->extents[i];
+		if (page >= e->page && page + pages <= e->page + e->pages)
+			return e->data + (size_t)(page - e->page) * CATALOG_PAGE_SIZE;
+	}
+	return NULL;
+}
+
+static int section_init(struct catalog *c, struct catalog_section *s, unsigned id,
+		const char *name, unsigned offs, unsigned len, unsigned count)
+{
+	s->data = NULL;
+	s->bytes = 0;
+	s->entry_count = count;
+	if (!len || !(c->sections & CATALOG_SECTION_BIT(id)))
+		return 0;
+
+	s->data = catalog_pages(c, offs, len);
+	if (!s->data) {
+		pr_debug(1, "%s section (pages %u..%u) is beyond the end of the catalog",
+				name, offs, offs + len);
+		errno = EINVAL;
+		return -1;
+	}
+
+	s->bytes = (size_t)len * CATALOG_PAGE_SIZE;
+	return 0;
+}
+
+#define SECTION_INIT(c, id, n) \
+	section_init(c, &(c)->n, id, #n, be_to_cpu((c)->p0->n##_data_offs), \
+			be_to_cpu((c)->p0->n##_data_len), \
+			be_to_cpu((c)->p0->n##_entry_count))
+
+/* With the pages in place, find page 0 and the sections. Closes @c on failure. */
+static int catalog_sections_init(struct catalog *c)
+{
+	c->p0 = c->base;
+	if (SECTION_INIT(c, CATALOG_SCHEMA, schema)
+			|| SECTION_INIT(c, CATALOG_EVENT, event)
+			|| SECTION_INIT(c, CATALOG_GROUP, group)
+			|| SECTION_INIT(c, CATALOG_FORMULA, formula)) {
+		catalog_close(c);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+int catalog_open(struct catalog *c, const char *path, unsigned sections)
+{
+	struct stat st;
+	int r, e;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	memset(c, 0, sizeof(*c));
+	c->sections = sections;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= CATALOG_PAGE_SIZE)
+		r = catalog_map(c, fd, st.st_size);
+	else
+		r = -1;
+
+	if (r)
+		r = catalog_read(c, fd, sections);
+
+	e = errno;
+	close(fd);
+	if (r) {
+		errno = e;
+		return -1;
+	}
+
+	return catalog_sections_init(c);
+}
+
+int catalog_adopt(struct catalog *c, void *buf, size_t bytes, unsigned sections)
+{
+	memset(c, 0, sizeof(*c));
+	c->sections = sections;
+	c->base = buf;
+	c->bytes = bytes;
+	c->extents[0] = (struct catalog_extent) { 0, bytes / CATALOG_PAGE_SIZE, buf };
+	c->nr_extents = 1;
+	if (bytes < CATALOG_PAGE_SIZE) {
+		catalog_close(c);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return catalog_sections_init(c);
+}
+
+void catalog_close(struct catalog *c)
+{
+	if (c->mapped)
+		munmap(c->base, c->bytes);
+	else
+		free(c->base);
+	c->base = NULL;
+}
+
+#define STREAM_CHUNK_PAGES 16
+
+int catalog_stream(int fd, const struct hv_24x7_catalog_page_0 *p0,
+		unsigned sections, catalog_page_fn fn, void *priv)
+{
+	struct page_range r[CATALOG_SECTION_COUNT];
+	unsigned id, last_page = 1;
+
+	section_ranges(p0, sections, r);
+
+	for (id = 0; id < CATALOG_SECTION_COUNT; id++) {
+		if (r[id].pages && !r[id].page) {
+			/* We've already gone past page 0 */
+			pr_debug(1, "section %u starts at page 0", id);
+			errno = EINVAL;
+			return -1;
+		}
+		if (r[id].pages)
+			last_page = max(last_page, r[id].page + r[id].pages);
+	}
+
+	void *chunk = malloc(STREAM_CHUNK_PAGES * CATALOG_PAGE_SIZE);
+	if (!chunk)
+		return -1;
+
+	unsigned page = 1;
+	int ret = 0;
+	while (page < last_page) {
+		size_t want = min((size_t)(last_page - page), (size_t)STREAM_CHUNK_PAGES);
+		ssize_t got = read_full(fd, chunk, want * CATALOG_PAGE_SIZE);
+		if (got < 0) {
+			ret = -1;
+			break;
+		}
+
+		size_t i, have = got / CATALOG_PAGE_SIZE;
+		for (i = 0; i < have; i++, page++) {
+			for (id = 0; id < CATALOG_SECTION_COUNT; id++) {
+				if (page < r[id].page || page >= r[id].page + r[id].pages)
+					continue;
+				if (fn(priv, id, chunk + i * CATALOG_PAGE_SIZE,
+						page + 1 == r[id].page + r[id].pages)) {
+					ret = 0;
+					goto out;
+				}
+			}
+		}
+
+		if (have < want) {
+			pr_debug(1, "catalog ended at page %u, expected %u pages", page, last_page);
+			errno = EPIPE;
+			ret = -1;
+			break;
+		}
+	}
+
+out:
+	free(chunk);
+	return ret;
+}
+
+int catalog_window_init(struct catalog_window *w, size_t size)
+{
+	w->buf = malloc(size);
+	if (!w->buf)
+		return -1;
+	w->size = size;
+	w->len = 0;
+	w->offset = 0;
+	return 0;
+}
+
+int catalog_window_append(struct catalog_window *w, const void *data, size_t len)
+{
+	if (len > w->size - w->len) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	memcpy(w->buf + w->len, data, len);
+	w->len += len;
+	return 0;
+}
+
+ssize_t catalog_window_pread(struct catalog_window *w, int fd, unsigned page, size_t bytes)
+{
+	/* everything before offset + len has been read, always whole pages */
+	size_t pos = w->offset + w->len;
+	if (pos >= bytes)
+		return 0;
+
+	size_t room = w->size - w->len;
+	size_t want = min(room - room % CATALOG_PAGE_SIZE, bytes - pos);
+	if (!want)
+		return 0;
+
+	struct iovec iov = { w->buf + w->len, want };
+	ssize_t got = readv_full(fd, &iov, 1, (off_t)page * CATALOG_PAGE_SIZE + pos);
+	if (got < 0)
+		return -1;
+	if ((size_t)got < want) {
+		pr_debug(1, "catalog ended %zu bytes into a section, expected %zu", pos + got, bytes);
+		errno = EPIPE;
+		return -1;
+	}
+
+	w->len += got;
+	return got;
+}
+
+void catalog_window_consume(struct catalog_window *w, size_t len)
+{
+	memmove(w->buf, w->buf + len, w->len - len);
+	w->len -= len;
+	w->offset += len;
+}
+
+void catalog_window_free(struct catalog_window *w)
+{
+	free(w->buf);
+	w->buf = NULL;
+}
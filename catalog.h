@@ -0,0 +1,134 @@
+#ifndef CATALOG_24X7_H_
+#define CATALOG_24X7_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define CATALOG_PAGE_SIZE 4096
+
+enum catalog_section_id {
+	CATALOG_SCHEMA,
+	CATALOG_EVENT,
+	CATALOG_GROUP,
+	CATALOG_FORMULA,
+	CATALOG_SECTION_COUNT
+};
+
+#define CATALOG_SECTION_BIT(id) (1u << (id))
+#define CATALOG_ALL_SECTIONS (CATALOG_SECTION_BIT(CATALOG_SECTION_COUNT) - 1)
+
+/*
+ * One of the schema, event, group, or formula areas of a catalog.
+ * @data points directly into the loaded catalog (no copies are made).
+ */
+struct catalog_section {
+	void *data;
+	size_t bytes;
+	unsigned entry_count;
+};
+
+/*
+ * A run of catalog pages that is present in memory. A mapped catalog is a
+ * single extent; a read one has page 0 plus one extent per merged run of
+ * section pages.
+ */
+struct catalog_extent {
+	unsigned page;
+	unsigned pages;
+	void *data;
+};
+
+#define CATALOG_MAX_EXTENTS 5
+
+struct catalog {
+	void *base;	/* the mapping or buffer holding the catalog */
+	size_t bytes;	/* bytes allocated/mapped at base */
+	bool mapped;	/* base came from mmap() rather than malloc() */
+
+	struct catalog_extent extents[CATALOG_MAX_EXTENTS];
+	unsigned nr_extents;
+
+	struct hv_24x7_catalog_page_0 *p0;
+	unsigned sections;	/* CATALOG_SECTION_BIT()s of those loaded */
+	struct catalog_section schema, event, group, formula;
+};
+
+/*
+ * Load the catalog at @path. Regular files are mmap()ed. Everything else
+ * (ie: the sysfs interface/catalog file) has page 0 read, followed by a
+ * single preadv() of the pages the sections occupy.
+ *
+ * Only the sections in @sections (a mask of CATALOG_SECTION_BIT()s) are
+ * read and made available; the others are left with no data.
+ *
+ * Returns 0 on success, or -1 with errno set.
+ */
+int catalog_open(struct catalog *c, const char *path, unsigned sections);
+
+/*
+ * Like catalog_open(), for a catalog of @bytes already in memory at @buf.
+ * @buf must come from malloc(); it is freed by catalog_close(), or here if
+ * the sections don't fit within it.
+ */
+int catalog_adopt(struct catalog *c, void *buf, size_t bytes, unsigned sections);
+void catalog_close(struct catalog *c);
+
+/* Read the first page of a catalog from @fd. Returns 0 or -1 with errno set. */
+int catalog_read_page0(int fd, void *page0);
+
+/*
+ * Sanity check page 0 on its own: the magic, and that every section lies
+ * after page 0 and within the length the catalog claims.
+ */
+bool catalog_page0_is_valid(const struct hv_24x7_catalog_page_0 *p0);
+
+/*
+ * Called once for each page of a section, in file order. @last is set on
+ * the final page of the section. Return non-zero to stop streaming.
+ */
+typedef int (*catalog_page_fn)(void *priv, enum catalog_section_id id,
+		void *page, bool last);
+
+/*
+ * Read the rest of a catalog (page 0, @p0, has already been consumed)
+ * sequentially from @fd, handing each page of the sections in @sections to
+ * @fn as it arrives. Reading stops after the last of those sections. Works
+ * on pipes and other non-seekable input. Returns 0, or -1 with errno set
+ * (EPIPE if the input ended before the last section did).
+ */
+int catalog_stream(int fd, const struct hv_24x7_catalog_page_0 *p0,
+		unsigned sections, catalog_page_fn fn, void *priv);
+
+/*
+ * A bounded buffer for walking a section a few pages at a time: pages are
+ * appended at the end and fully walked records are consumed from the front.
+ */
+struct catalog_window {
+	void *buf;
+	size_t size;	/* capacity of buf */
+	size_t len;	/* bytes currently held */
+	size_t offset;	/* section offset of buf[0] */
+};
+
+/*
+ * The smallest useful window: room for the largest possible record (their
+ * lengths are 16 bits) still straddling a page, plus the page after it.
+ */
+#define CATALOG_WINDOW_MIN (UINT16_MAX + 2 * CATALOG_PAGE_SIZE)
+
+int catalog_window_init(struct catalog_window *w, size_t size);
+/* Returns -1 with errno = ENOBUFS if @len bytes won't fit */
+int catalog_window_append(struct catalog_window *w, const void *data, size_t len);
+/*
+ * Top up @w with as many whole pages as fit from the section of @bytes
+ * bytes starting at @page of the (seekable) catalog @fd. Returns the number
+ * of bytes added, 0 if the section is exhausted or no page fits, or -1 with
+ * errno set (EPIPE if the file ends within the section).
+ */
+ssize_t catalog_window_pread(struct catalog_window *w, int fd, unsigned page, size_t bytes);
+void catalog_window_consume(struct catalog_window *w, size_t len);
+void catalog_window_free(struct catalog_window *w);
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <ccan/pr_debug/pr_debug.h>
+#include <ccan/array_size/array_size.h>
+#include <ccan/err/err.h>
+#include <ccan/endian/endian.h>
+
+#include <penny/math.h>
+
+#include "catalog.h"
+#include "check.h"
+
+/*
+ * The record validators never form a pointer past the data they are given:
+ * bounds are worked out as byte counts from the start of the record, and
+ * since every length read is 16 bits, sums of a few of them can't overflow.
+ * Length fields that follow names and descriptions need not be aligned, so
+ * they are copied out rather than dereferenced.
+ */
+static unsigned be16_at(const void *p)
+{
+	__be16 v;
+	memcpy(&v, p, sizeof(v));
+	return be_to_cpu(v);
+}
+
+/* Bytes from @start to @end, or 0 if @end comes first */
+static size_t bytes_before(const void *start, const void *end)
+{
+	return end > start ? (size_t)(end - start) : 0;
+}
+
+bool record_is_within(void *rec, size_t len, void *end)
+{
+	return len <= bytes_before(rec, end);
+}
+
+bool schema_fixed_portion_is_within(struct hv_24x7_grs *schema, void *end)
+{
+	return sizeof(*schema) < bytes_before(schema, end);
+}
+
+bool schema_is_within(struct hv_24x7_grs *schema, void *end)
+{
+	size_t avail = bytes_before(schema, end);
+	if (avail < sizeof(*schema)) {
+		pr_debug(1, "%s: fixed portion is cut off (%zu bytes)", __func__, avail);
+		return false;
+	}
+
+	unsigned field_entry_count = be_to_cpu(schema->field_entry_count);
+	if (!field_entry_count) {
+		pr_debug(1, "%s: no field entries", __func__);
+		return false;
+	}
+
+	size_t field_entry_bytes = field_entry_count * sizeof(struct hv_24x7_grs_field);
+	if (field_entry_bytes > avail - sizeof(*schema)) {
+		pr_debug(1, "%s: field_entry_bytes=%zu > %zu bytes available", __func__,
+				field_entry_bytes, avail - sizeof(*schema));
+		return false;
+	}
+
+	return true;
+}
+
+bool group_fixed_portion_is_within(struct hv_24x7_group_data *group, void *end)
+{
+	return sizeof(*group) < bytes_before(group, end);
+}
+
+bool group_is_within(struct hv_24x7_group_data *group, void *end)
+{
+	size_t avail = bytes_before(group, end);
+	if (avail < sizeof(*group)) {
+		pr_debug(1, "%s: fixed portion is cut off (%zu bytes)", __func__, avail);
+		return false;
+	}
+	/* from here on, everything is measured from the remainder */
+	avail -= sizeof(*group);
+
+	size_t nl = be_to_cpu(group->group_name_len);
+	if (nl < 2) {
+		pr_debug(1, "%s: name length too short: %zu", __func__, nl);
+		return false;
+	}
+
+	/* the name, then the desc length */
+	if (nl > avail) {
+		pr_debug(1, "%s: nl=%zu > %zu bytes available", __func__, nl, avail);
+		return false;
+	}
+
+	size_t dl = be16_at(group->remainder + nl - 2);
+	if (dl < 2) {
+		pr_debug(1, "%s: desc len too short: %zu", __func__, dl);
+		return false;
+	}
+
+	/* the desc, which takes dl - 2 bytes */
+	if (nl + dl - 2 > avail) {
+		pr_debug(1, "%s: nl=%zu + dl=%zu - 2 > %zu bytes available", __func__, nl, dl, avail);
+		return false;
+	}
+
+	return true;
+}
+
+bool event_fixed_portion_is_within(struct hv_24x7_event_data *ev, void *end)
+{
+	return offsetof(struct hv_24x7_event_data, remainder) < bytes_before(ev, end);
+}
+
+/*
+ * Things we don't check:
+ *  - padding for desc, name, and long/detailed desc is required to be '\0' bytes.
+ */
+bool event_is_within(struct hv_24x7_event_data *ev, void *end)
+{
+	size_t avail = bytes_before(ev, end);
+	if (avail < offsetof(struct hv_24x7_event_data, remainder)) {
+		pr_debug(1, "%s: fixed portion is cut off (%zu bytes)", __func__, avail);
+		return false;
+	}
+	/* from here on, everything is measured from the remainder */
+	avail -= offsetof(struct hv_24x7_event_data, remainder);
+
+	size_t nl = be_to_cpu(ev->event_name_len);
+	if (nl < 2) {
+		pr_debug(1, "%s: name length too short: %zu", __func__, nl);
+		return false;
+	}
+
+	/* the name, then the desc length */
+	if (nl > avail) {
+		pr_debug(1, "%s: nl=%zu > %zu bytes available", __func__, nl, avail);
+		return false;
+	}
+
+	if (!IS_ALIGNED((uintptr_t)(ev->remainder + nl - 2), 2))
+		warnx("desc len not aligned %p", ev->remainder + nl - 2);
+	size_t dl = be16_at(ev->remainder + nl - 2);
+	if (dl < 2) {
+		pr_debug(1, "%s: desc len too short: %zu", __func__, dl);
+		return false;
+	}
+
+	/* the desc, then the long desc length */
+	if (nl + dl > avail) {
+		pr_debug(1, "%s: nl=%zu + dl=%zu > %zu bytes available", __func__, nl, dl, avail);
+		return false;
+	}
+
+	if (!IS_ALIGNED((uintptr_t)(ev->remainder + nl + dl - 2), 2))
+		warnx("long desc len not aligned %p", ev->remainder + nl + dl - 2);
+	size_t ldl = be16_at(ev->remainder + nl + dl - 2);
+	if (ldl < 2) {
+		pr_debug(1, "%s: long desc len too short (ldl=%zu)", __func__, ldl);
+		return false;
+	}
+
+	/* the long desc, which takes ldl - 2 bytes */
+	if (nl + dl + ldl - 2 > avail) {
+		pr_debug(1, "%s: nl=%zu + dl=%zu + ldl=%zu - 2 > %zu bytes available", __func__,
+				nl, dl, ldl, avail);
+		return false;
+	}
+
+	return true;
+}
+
+enum event_verdict event_check(struct hv_24x7_event_data *ev, size_t offset, void *end,
+		bool *crosses_page)
+{
+	*crosses_page = false;
+	if (!event_fixed_portion_is_within(ev, end))
+		return EVENT_FIXED_OUTSIDE;
+
+	size_t len = be_to_cpu(ev->length);
+	if (len < offsetof(struct hv_24x7_event_data, remainder))
+		return EVENT_TOO_SHORT;
+	if (ev->event_group_record_len == 0)
+		return EVENT_SKIPPED;
+
+	if (!record_is_within(ev, len, end))
+		return EVENT_ENDS_AFTER;
+	if (!event_is_within(ev, end))
+		return EVENT_EXCEEDS_DATA;
+	if (!event_is_within(ev, (void *)ev + len))
+		return EVENT_EXCEEDS_OWN;
+
+	/* the record need not be in a page aligned buffer, go by the section offset */
+	size_t to_page_end = CATALOG_PAGE_SIZE - offset % CATALOG_PAGE_SIZE;
+	*crosses_page = !event_is_within(ev, (void *)ev + min(to_page_end, len));
+	return EVENT_OK;
+}
+
+/*
+ * Below this many pages for each thread, starting threads costs more than
+ * the checks they would share.
+ */
+#define EVENTS_CHECK_MIN_PAGES 16
+
+/* Pages handed to a worker at a time */
+#define EVENTS_CHECK_CLAIM 4
+
+struct events_check_state {
+	void *buf, *end;
+	struct event_check *checks;
+	size_t *page_first;	/* first record starting in each page, nr_pages + 1 entries */
+	size_t nr_pages;
+
+	pthread_mutex_t lock;
+	size_t next_page;
+};
+
+static void *events_check_worker(void *arg)
+{
+	struct events_check_state *s = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&s->lock);
+		size_t p = s->next_page;
+		s->next_page = min(p + EVENTS_CHECK_CLAIM, s->nr_pages);
+		pthread_mutex_unlock(&s->lock);
+		if (p >= s->nr_pages)
+			return NULL;
+
+		size_t i, last = s->page_first[min(p + EVENTS_CHECK_CLAIM, s->nr_pages)];
+		for (i = s->page_first[p]; i < last; i++) {
+			struct event_check *c = &s->checks[i];
+			c->verdict = event_check(s->buf + c->offset, c->offset, s->end,
+					&c->crosses_page);
+		}
+	}
+}
+
+struct event_check *events_check(void *buf, size_t len, unsigned count,
+		unsigned jobs, size_t *nr)
+{
+	struct events_check_state s = {
+		.buf = buf,
+		.end = buf + len,
+		.nr_pages = DIV_ROUND_UP(len, CATALOG_PAGE_SIZE),
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	size_t i, p = 0, offset = 0;
+
+	s.checks = malloc(max(count, 1u) * sizeof(*s.checks));
+	s.page_first = malloc((s.nr_pages + 1) * sizeof(*s.page_first));
+	if (!s.checks || !s.page_first) {
+		free(s.checks);
+		free(s.page_first);
+		return NULL;
+	}
+
+	/*
+	 * Following the chain of lengths is the only part that has to be done
+	 * in order. It stops where walk_events() would stop regardless of what
+	 * the full checks find.
+	 */
+	for (i = 0; i < count && offset < len; i++) {
+		struct hv_24x7_event_data *ev = buf + offset;
+		while (p <= s.nr_pages && p * CATALOG_PAGE_SIZE <= offset)
+			s.page_first[p++] = i;
+		s.checks[i].offset = offset;
+		if (!event_fixed_portion_is_within(ev, s.end)) {
+			i++;
+			break;
+		}
+
+		size_t ev_len = be_to_cpu(ev->length);
+		if (ev_len < offsetof(struct hv_24x7_event_data, remainder)
+				|| (ev->event_group_record_len && ev_len > len - offset)) {
+			i++;
+			break;
+		}
+		offset += ev_len;
+	}
+	*nr = i;
+	for (; p <= s.nr_pages; p++)
+		s.page_first[p] = i;
+
+	jobs = min(max(jobs, 1u), (unsigned)max(s.nr_pages / EVENTS_CHECK_MIN_PAGES, (size_t)1));
+	pthread_t threads[jobs];
+	unsigned started;
+	for (started = 0; started + 1 < jobs; started++) {
+		if (pthread_create(&threads[started], NULL, events_check_worker, &s)) {
+			pr_debug(1, "only started %u of %u event checkers", started + 1, jobs);
+			break;
+		}
+	}
+
+	events_check_worker(&s);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	pr_debug(2, "checked %zu events over %zu pages with %u threads", *nr, s.nr_pages, started + 1);
+	free(s.page_first);
+	return s.checks;
+}
+
+/* Just enough of a bitmap for marking record indexes (at most 16 bits) */
+#define BITS_PER_WORD (sizeof(unsigned long) * CHAR_BIT)
+
+static inline void bit_set(unsigned long *map, size_t i)
+{
+	map[i / BITS_PER_WORD] |= 1UL << (i % BITS_PER_WORD);
+}
+
+static inline bool bit_test(const unsigned long *map, size_t i)
+{
+	return map[i / BITS_PER_WORD] & (1UL << (i % BITS_PER_WORD));
+}
+
+static void xref_error(struct xref_report *r, enum xref_kind kind, uint32_t from, uint32_t to)
+{
+	if (r->nr_errors < XREF_ERRORS_MAX)
+		r->errors[r->nr_errors] = (struct xref_error) {
+			.kind = kind,
+			.from = from,
+			.to = to,
+		};
+	r->nr_errors++;
+	r->count[kind]++;
+}
+
+void xref_seen_init(struct xref_seen *x, const struct hv_24x7_catalog_page_0 *p0)
+{
+	x->nr_schema_ixs = be_to_cpu(p0->schema_entry_count);
+	x->nr_event_ixs = be_to_cpu(p0->event_entry_count);
+
+	/* sized from page 0, so they are allocated at once */
+	size_t schema_words = DIV_ROUND_UP(x->nr_schema_ixs, BITS_PER_WORD);
+	size_t event_words = DIV_ROUND_UP(x->nr_event_ixs, BITS_PER_WORD);
+	x->schema_present = calloc(schema_words + 2 * event_words + 1, sizeof(*x->schema_present));
+	x->primary_group = malloc(sizeof(*x->primary_group) * (x->nr_event_ixs + 1));
+	if (!x->schema_present || !x->primary_group)
+		err(1, "alloc failure for cross-reference checks");
+	x->event_present = x->schema_present + schema_words;
+	x->event_live = x->event_present + event_words;
+}
+
+void xref_seen_free(struct xref_seen *x)
+{
+	free(x->schema_present);
+	free(x->primary_group);
+}
+
+void xref_see_schema(struct xref_seen *x, const struct catalog_schema *schema)
+{
+	if (schema->index < x->nr_schema_ixs)
+		bit_set(x->schema_present, schema->index);
+}
+
+void xref_see_event(struct xref_seen *x, const struct catalog_model *m, size_t row)
+{
+	const struct catalog_events *e = &m->events;
+	uint32_t ix = e->index[row];
+
+	if (ix >= x->nr_event_ixs)
+		return;
+	bit_set(x->event_present, ix);
+	if (!e->skipped[row]) {
+		bit_set(x->event_live, ix);
+		x->primary_group[ix] = e->primary_group_ix[row];
+	}
+}
+
+size_t xref_check(const struct xref_seen *x, const struct catalog_model *m,
+		unsigned sections, struct xref_report *r)
+{
+	unsigned nr_group_ixs = be_to_cpu(m->p0.group_entry_count);
+	bool have_schemas = sections & CATALOG_SECTION_BIT(CATALOG_SCHEMA);
+	bool have_events = sections & CATALOG_SECTION_BIT(CATALOG_EVENT);
+	size_t i, k;
+
+	memset(r, 0, sizeof(*r));
+
+	for (i = 0; i < m->nr_groups; i++) {
+		const struct catalog_group *g = &m->groups[i];
+		size_t count = g->event_count;
+
+		if (g->schema_ix >= x->nr_schema_ixs
+				|| (have_schemas && !bit_test(x->schema_present, g->schema_ix)))
+			xref_error(r, XREF_GROUP_SCHEMA, g->index, g->schema_ix);
+
+		if (!count || count > ARRAY_SIZE(g->event_ixs)) {
+			xref_error(r, XREF_GROUP_EVENT_COUNT, g->index, count);
+			count = min(count, ARRAY_SIZE(g->event_ixs));
+		}
+
+		for (k = 0; k < count; k++) {
+			unsigned ix = g->event_ixs[k];
+			if (ix == UINT16_MAX)
+				continue;
+			if (ix >= x->nr_event_ixs) {
+				xref_error(r, XREF_GROUP_EVENT, g->index, ix);
+				continue;
+			}
+			if (have_events && bit_test(x->event_present, ix) && !bit_test(x->event_live, ix))
+				xref_error(r, XREF_GROUP_SKIPPED_EVENT, g->index, ix);
+		}
+	}
+
+	for (i = 0; i < x->nr_event_ixs; i++)
+		if (bit_test(x->event_live, i) && x->primary_group[i] >= nr_group_ixs)
+			xref_error(r, XREF_EVENT_PRIMARY_GROUP, i, x->primary_group[i]);
+
+	return r->nr_errors;
+}
+
+size_t model_check_xrefs(const struct catalog_model *m, unsigned sections,
+		struct xref_report *r)
+{
+	struct xref_seen x;
+	size_t i, n;
+
+	xref_seen_init(&x, &m->p0);
+	for (i = 0; i < m->nr_schemas; i++)
+		xref_see_schema(&x, &m->schemas[i]);
+	for (i = 0; i < m->nr_events; i++)
+		xref_see_event(&x, m, i);
+	n = xref_check(&x, m, sections, r);
+	xref_seen_free(&x);
+	return n;
+}
@@ -0,0 +1,128 @@
+#ifndef CATALOG_CHECK_H_
+#define CATALOG_CHECK_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define __packed __attribute__((__packed__))
+#include "hv-24x7-catalog.h"
+#include "model.h"
+
+/*
+ * Checking event records against the section holding them, either one at a
+ * time as the walkers reach them, or the whole event section up front,
+ * spread over several threads; and checking that the records of a decoded
+ * model refer to each other sensibly.
+ */
+
+enum event_verdict {
+	EVENT_OK,
+	EVENT_SKIPPED,		/* event_group_record_len == 0, not checked further */
+	EVENT_FIXED_OUTSIDE,	/* the fixed portion runs past the section */
+	EVENT_TOO_SHORT,	/* length doesn't cover the fixed portion */
+	EVENT_ENDS_AFTER,	/* length runs past the section */
+	EVENT_EXCEEDS_DATA,	/* name or descs run past the section */
+	EVENT_EXCEEDS_OWN,	/* name or descs run past the record's length */
+};
+
+struct event_check {
+	uint32_t offset;	/* section offset of the record */
+	uint8_t verdict;	/* enum event_verdict */
+	bool crosses_page;	/* an EVENT_OK record not contained in one page */
+};
+
+/* Does the @len byte record at @rec end by @end? */
+bool record_is_within(void *rec, size_t len, void *end);
+
+/*
+ * Does the fixed portion of a record start before @end, and do the
+ * variable parts it describes (fields, or names and descriptions) all end
+ * by @end? Safe against any length a record might claim.
+ */
+bool schema_fixed_portion_is_within(struct hv_24x7_grs *schema, void *end);
+bool schema_is_within(struct hv_24x7_grs *schema, void *end);
+bool group_fixed_portion_is_within(struct hv_24x7_group_data *group, void *end);
+bool group_is_within(struct hv_24x7_group_data *group, void *end);
+bool event_fixed_portion_is_within(struct hv_24x7_event_data *ev, void *end);
+bool event_is_within(struct hv_24x7_event_data *ev, void *end);
+
+/*
+ * Check the event record @ev, at @offset of its section, against the data
+ * ending at @end. Records following one that is neither EVENT_OK nor
+ * EVENT_SKIPPED can't be trusted to be records at all.
+ */
+enum event_verdict event_check(struct hv_24x7_event_data *ev, size_t offset, void *end,
+		bool *crosses_page);
+
+/*
+ * Check the (up to @count) records of the event section @buf of @len bytes
+ * in order, as walk_events() would, using up to @jobs threads. Records
+ * don't keep to pages, so the offset of each is first found by following
+ * their lengths; the checks themselves are then handed out a few pages at
+ * a time. Returns an array of the checks (*@nr of them, covering every
+ * record the walk could reach), or NULL if it could not be allocated.
+ */
+struct event_check *events_check(void *buf, size_t len, unsigned count,
+		unsigned jobs, size_t *nr);
+
+enum xref_kind {
+	XREF_GROUP_SCHEMA,		/* group's schema index is past the schemas */
+	XREF_GROUP_EVENT_COUNT,		/* group's event_count is not 1 to 16 */
+	XREF_GROUP_EVENT,		/* group lists an event index past the events */
+	XREF_GROUP_SKIPPED_EVENT,	/* group lists an event that has no data */
+	XREF_EVENT_PRIMARY_GROUP,	/* event's primary group is past the groups */
+	XREF_KIND_COUNT
+};
+
+/* @from is the index of the referring record, @to what it referred to */
+struct xref_error {
+	uint32_t kind;		/* enum xref_kind */
+	uint32_t from;
+	uint32_t to;
+};
+
+/* Only the first few errors are kept, but all of them are counted */
+#define XREF_ERRORS_MAX 32
+
+struct xref_report {
+	size_t count[XREF_KIND_COUNT];
+	size_t nr_errors;		/* in total */
+	struct xref_error errors[XREF_ERRORS_MAX];
+};
+
+/*
+ * Check every reference between the records of @m in one pass over the
+ * groups and one over the events. References are checked against the entry
+ * counts of page 0 and, within the @sections (CATALOG_SECTION_BIT()s) that
+ * were walked, against the records that were decoded.
+ *
+ * Whether an event's primary group, or group_count groups, list it isn't
+ * checked: in the catalogs seen so far they mostly don't.
+ *
+ * Returns the number of errors.
+ */
+size_t model_check_xrefs(const struct catalog_model *m, unsigned sections,
+		struct xref_report *r);
+
+/*
+ * The same checks for walks that drop their schema and event records as
+ * they go: what they need of each is noted as it is decoded, in bitmaps
+ * and a table sized from page 0. The groups are still read from the model.
+ */
+struct xref_seen {
+	unsigned nr_schema_ixs, nr_event_ixs;
+	unsigned long *schema_present, *event_present, *event_live;
+	uint16_t *primary_group;	/* of each live event, by index */
+};
+
+void xref_seen_init(struct xref_seen *x, const struct hv_24x7_catalog_page_0 *p0);
+void xref_seen_free(struct xref_seen *x);
+void xref_see_schema(struct xref_seen *x, const struct catalog_schema *schema);
+void xref_see_event(struct xref_seen *x, const struct catalog_model *m, size_t row);
+
+/* model_check_xrefs(), given the records noted in @x and the groups of @m */
+size_t xref_check(const struct xref_seen *x, const struct catalog_model *m,
+		unsigned sections, struct xref_report *r);
+
+#endif
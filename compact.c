@@ -0,0 +1,241 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccan/err/err.h>
+#include <ccan/pr_debug/pr_debug.h>
+#include <ccan/endian/endian.h>
+
+#include <penny/math.h>
+
+#include "model.h"
+#include "compact.h"
+
+/* What counter_cmp() orders by, set per thread just like select.c's sort_model */
+static __thread const struct catalog_compact *sort_compact;
+
+static int counter_cmp(const void *a_, const void *b_)
+{
+	uint16_t a = *(const uint16_t *)a_, b = *(const uint16_t *)b_;
+	const struct compact_event *ea = &sort_compact->events[a];
+	const struct compact_event *eb = &sort_compact->events[b];
+
+	if (ea->domain != eb->domain)
+		return ea->domain < eb->domain ? -1 : 1;
+	if (ea->offset != eb->offset)
+		return ea->offset < eb->offset ? -1 : 1;
+	return a < b ? -1 : a > b;
+}
+
+#define TABLE_BYTES(n, type) ALIGN((n) * sizeof(type), (size_t)ARENA_ALIGN)
+
+int compact_build(struct catalog_compact *c, const struct catalog_model *m)
+{
+	const struct catalog_events *e = &m->events;
+	size_t i, j, n = 0, names_len = 0, nr_eg = 0, nr_ge = 0;
+	const uint16_t *ixs;
+	int r = -1;
+
+	memset(c, 0, sizeof(*c));
+	arena_init(&c->arena);
+	if (!m->nr_name_slot)
+		return -1;
+
+	uint32_t *ix = malloc(sizeof(*ix) * (m->nr_events + 1));
+	uint32_t *ev_name = malloc(sizeof(*ev_name) * (m->nr_events + 1));
+	uint32_t *group_name = malloc(sizeof(*group_name) * (m->nr_groups + 1));
+	if (!ix || !ev_name || !group_name)
+		err(1, "alloc failure");
+
+	/*
+	 * Number the events and place the names. A name that an earlier
+	 * event already has (groups are mostly named after one of their
+	 * events) points at that copy.
+	 */
+	for (i = 0; i < m->nr_events; i++) {
+		ix[i] = UINT32_MAX;
+		if (e->skipped[i])
+			continue;
+		ix[i] = n++;
+
+		size_t len = model_name_len(m, e->name[i]);
+		ssize_t first = model_find_event(m, model_str(m, e->name[i]), len);
+		if (first >= 0 && (size_t)first < i) {
+			ev_name[i] = ev_name[first];
+		} else {
+			ev_name[i] = names_len;
+			names_len += len + 1;
+		}
+
+		size_t nr = model_event_groups(m, i, &ixs);
+		for (j = 0; j < nr; j++)
+			nr_eg += ixs[j] < m->nr_groups;
+	}
+
+	for (i = 0; i < m->nr_groups; i++) {
+		size_t len = model_name_len(m, m->groups[i].name);
+		ssize_t ev = model_find_event(m, model_str(m, m->groups[i].name), len);
+		if (ev >= 0) {
+			group_name[i] = ev_name[ev];
+		} else {
+			group_name[i] = names_len;
+			names_len += len + 1;
+		}
+
+		size_t nr = model_group_events(m, i, &ixs);
+		for (j = 0; j < nr; j++)
+			nr_ge += ixs[j] < m->nr_events && ix[ixs[j]] != UINT32_MAX;
+	}
+
+	if (n > UINT16_MAX || m->nr_groups > UINT16_MAX
+			|| nr_eg > UINT16_MAX || nr_ge > UINT16_MAX) {
+		pr_debug(1, "%zu events, %zu groups, and %zu + %zu memberships won't pack",
+				n, m->nr_groups, nr_eg, nr_ge);
+		goto out;
+	}
+
+	arena_reserve(&c->arena, TABLE_BYTES(n, struct compact_event)
+			+ TABLE_BYTES(n, struct compact_record)
+			+ TABLE_BYTES(m->nr_groups, struct compact_group)
+			+ TABLE_BYTES(names_len, char)
+			+ TABLE_BYTES(nr_eg, uint16_t)
+			+ TABLE_BYTES(nr_ge, uint16_t)
+			+ TABLE_BYTES(m->nr_name_disp, uint32_t)
+			+ TABLE_BYTES(m->nr_name_slot, uint16_t)
+			+ TABLE_BYTES(n, uint16_t));
+	c->events = arena_alloc(&c->arena, sizeof(*c->events) * n);
+	c->records = arena_alloc(&c->arena, sizeof(*c->records) * n);
+	c->groups = arena_alloc(&c->arena, sizeof(*c->groups) * m->nr_groups);
+	c->names = arena_alloc(&c->arena, names_len);
+	c->event_groups = arena_alloc(&c->arena, sizeof(*c->event_groups) * nr_eg);
+	c->group_events = arena_alloc(&c->arena, sizeof(*c->group_events) * nr_ge);
+	c->name_disp = arena_alloc(&c->arena, sizeof(*c->name_disp) * m->nr_name_disp);
+	c->name_slot = arena_alloc(&c->arena, sizeof(*c->name_slot) * m->nr_name_slot);
+	c->by_counter = arena_alloc(&c->arena, sizeof(*c->by_counter) * n);
+	c->nr_events = n;
+	c->catalog_events = be_to_cpu(m->p0.event_entry_count);
+	c->nr_groups = m->nr_groups;
+	c->names_len = names_len;
+	c->nr_name_disp = m->nr_name_disp;
+	c->nr_name_slot = m->nr_name_slot;
+
+	for (i = 0; i < m->nr_events; i++) {
+		if (ix[i] == UINT32_MAX)
+			continue;
+
+		struct compact_event *ce = &c->events[ix[i]];
+		size_t len = model_name_len(m, e->name[i]), nr = model_event_groups(m, i, &ixs);
+
+		memcpy(c->names + ev_name[i], model_str(m, e->name[i]), len);
+		c->names[ev_name[i] + len] = '\0';
+
+		*ce = (struct compact_event) {
+			.name = ev_name[i],
+			.offset = e->counter_offs[i] + e->group_record_offs[i],
+			.first_group = c->nr_event_groups,
+			.domain = e->domain[i],
+		};
+		c->records[ix[i]] = (struct compact_record) {
+			.offset = e->offset[i],
+			.index = e->index[i],
+			.length = e->length[i],
+		};
+		for (j = 0; j < nr; j++)
+			if (ixs[j] < m->nr_groups)
+				c->event_groups[c->nr_event_groups++] = ixs[j];
+		if (c->nr_event_groups - ce->first_group > UINT8_MAX) {
+			pr_debug(1, "event %u is in too many groups to pack", e->index[i]);
+			goto out;
+		}
+		ce->nr_groups = c->nr_event_groups - ce->first_group;
+	}
+
+	for (i = 0; i < m->nr_groups; i++) {
+		const struct catalog_group *g = &m->groups[i];
+		struct compact_group *cg = &c->groups[i];
+		size_t len = model_name_len(m, g->name), nr = model_group_events(m, i, &ixs);
+
+		memcpy(c->names + group_name[i], model_str(m, g->name), len);
+		c->names[group_name[i] + len] = '\0';
+
+		*cg = (struct compact_group) {
+			.name = group_name[i],
+			.first_event = c->nr_group_events,
+			.domain = g->domain,
+		};
+		for (j = 0; j < nr; j++)
+			if (ixs[j] < m->nr_events && ix[ixs[j]] != UINT32_MAX)
+				c->group_events[c->nr_group_events++] = ix[ixs[j]];
+		cg->nr_events = c->nr_group_events - cg->first_event;
+	}
+
+	memcpy(c->name_disp, m->name_disp, sizeof(*c->name_disp) * m->nr_name_disp);
+	for (i = 0; i < m->nr_name_slot; i++)
+		c->name_slot[i] = ix[m->name_slot[i]];
+
+	for (i = 0; i < n; i++)
+		c->by_counter[i] = i;
+	sort_compact = c;
+	qsort(c->by_counter, n, sizeof(*c->by_counter), counter_cmp);
+	r = 0;
+
+out:
+	free(group_name);
+	free(ev_name);
+	free(ix);
+	if (r)
+		compact_free(c);
+	return r;
+}
+
+void compact_free(struct catalog_compact *c)
+{
+	arena_free(&c->arena);
+	memset(c, 0, sizeof(*c));
+}
+
+ssize_t compact_find_event(const struct catalog_compact *c, const char *name, size_t len)
+{
+	if (!c->nr_name_slot)
+		return -1;
+
+	uint64_t h = catalog_name_hash(name, len);
+	uint32_t disp = c->name_disp[catalog_name_bucket(h, c->nr_name_disp)];
+	size_t ev = c->name_slot[catalog_name_slot(h, disp, c->nr_name_slot)];
+	const char *n = c->names + c->events[ev].name;
+
+	if (strncmp(n, name, len) || n[len])
+		return -1;
+	return ev;
+}
+
+ssize_t compact_find_counter(const struct catalog_compact *c, unsigned domain, uint32_t offset)
+{
+	size_t lo = 0, hi = c->nr_events;
+
+	/* the first event not before (domain, offset) */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct compact_event *e = &c->events[c->by_counter[mid]];
+		if (e->domain < domain || (e->domain == domain && e->offset < offset))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == c->nr_events)
+		return -1;
+	const struct compact_event *e = &c->events[c->by_counter[lo]];
+	if (e->domain != domain || e->offset != offset)
+		return -1;
+	return c->by_counter[lo];
+}
@@ -0,0 +1,79 @@
+#ifndef CATALOG_COMPACT_H_
+#define CATALOG_COMPACT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "arena.h"
+
+struct catalog_model;
+
+/*
+ * Just what collection needs, packed: the name, domain, counter offset and
+ * groups of each (not skipped) event, the name, domain and events of each
+ * group, and lookups by name and by counter. Each event's record position
+ * is kept apart, only for printing its banner. Descriptions and everything
+ * else in the model are left behind. Events and groups are numbered by
+ * their place in these tables.
+ */
+struct compact_event {
+	uint32_t name;		/* offset in names */
+	uint32_t offset;	/* of the counter, perf's offset= */
+	uint16_t first_group;	/* in event_groups */
+	uint8_t domain;
+	uint8_t nr_groups;
+};
+
+/* Where an event's record was, in its section */
+struct compact_record {
+	uint32_t offset;
+	uint16_t index;
+	uint16_t length;
+};
+
+struct compact_group {
+	uint32_t name;
+	uint16_t first_event;	/* in group_events */
+	uint8_t domain;
+	uint8_t nr_events;
+};
+
+struct catalog_compact {
+	struct compact_event *events;
+	size_t nr_events;
+	struct compact_record *records;	/* one per event */
+	unsigned catalog_events;	/* page 0's event count */
+	struct compact_group *groups;
+	size_t nr_groups;
+	char *names;		/* nul terminated, a group sharing an event's name shares its copy */
+	size_t names_len;
+	uint16_t *event_groups;
+	size_t nr_event_groups;
+	uint16_t *group_events;
+	size_t nr_group_events;
+	uint32_t *name_disp;	/* the model's name hash (see model.h) */
+	size_t nr_name_disp;
+	uint16_t *name_slot;
+	size_t nr_name_slot;
+	uint16_t *by_counter;	/* events sorted by domain, then offset */
+
+	struct arena arena;	/* holds all of the above, exactly */
+};
+
+/*
+ * Pack @m, a complete model with its event names and groups indexed, into
+ * @c. Returns 0, or -1 if the names have no hash or @m is too large for
+ * the packed fields (more than 65535 events, groups or memberships, or an
+ * event in more than 255 groups).
+ */
+int compact_build(struct catalog_compact *c, const struct catalog_model *m);
+void compact_free(struct catalog_compact *c);
+
+/* Returns the event named @name, or -1 */
+ssize_t compact_find_event(const struct catalog_compact *c, const char *name, size_t len);
+
+/* Returns the (first) event counting at @offset in catalog domain @domain, or -1 */
+ssize_t compact_find_counter(const struct catalog_compact *c, unsigned domain, uint32_t offset);
+
+#endif
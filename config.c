@@ -0,0 +1,140 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <ccan/err/err.h>
+
+#include "config.h"
+
+static bool parse_u64(const char *p, uint64_t *v, const char **end_)
+{
+	char *end;
+	errno = 0;
+	unsigned long long x = strtoull(p, &end, 0);
+	if (end == p || errno)
+		return false;
+	*v = x;
+	if (end_)
+		*end_ = end;
+	return true;
+}
+
+/* The value of the "@key=" term in @s */
+static bool find_term(const char *s, const char *key, uint64_t *v)
+{
+	size_t len = strlen(key);
+	const char *p = s;
+
+	while ((p = strstr(p, key))) {
+		bool start = p == s || p[-1] == ',' || p[-1] == '/' || isspace((unsigned char)p[-1]);
+		p += len;
+		if (start && *p == '=')
+			return parse_u64(p + 1, v, NULL);
+	}
+	return false;
+}
+
+/* The value of a "config: " or "config = " field (but not config1, etc) */
+static bool find_config_field(const char *s, uint64_t *v)
+{
+	const char *p = s;
+
+	while ((p = strstr(p, "config"))) {
+		p += strlen("config");
+		if (isalnum((unsigned char)*p) || *p == '_')
+			continue;
+		p += strspn(p, " \t");
+		if (*p != ':' && *p != '=')
+			continue;
+		return parse_u64(p + 1, v, NULL);
+	}
+	return false;
+}
+
+int hv_24x7_config_parse(const char *s, struct hv_24x7_config *c)
+{
+	uint64_t domain, offset, config;
+	const char *end;
+
+	if (find_term(s, "domain", &domain) && find_term(s, "offset", &offset)) {
+		if (domain > 0xf || offset > UINT32_MAX)
+			return -1;
+		c->domain = domain;
+		c->offset = offset;
+		return 0;
+	}
+
+	s += strspn(s, " \t");
+	if (find_config_field(s, &config)
+			|| (parse_u64(s, &config, &end) && !end[strspn(end, " \t")])) {
+		c->domain = config & 0xf;
+		c->offset = config >> 32;
+		return 0;
+	}
+
+	return -1;
+}
+
+int config_list_add_from(struct config_list *l, const char *file)
+{
+	FILE *f = strcmp(file, "-") ? fopen(file, "r") : stdin;
+	char *line = NULL;
+	size_t sz = 0, lineno = 0;
+	ssize_t len;
+	int r = 0;
+
+	if (!f)
+		return -1;
+
+	while (!r && (len = getline(&line, &sz, f)) >= 0) {
+		struct hv_24x7_config c;
+
+		lineno++;
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (!len)
+			continue;
+		if (hv_24x7_config_parse(line, &c)) {
+			warnx("%s:%zu: no hv_24x7 config in '%s'", file, lineno, line);
+			continue;
+		}
+
+		if (l->nr == l->alloc) {
+			size_t n = l->alloc ? l->alloc * 2 : 64;
+			struct hv_24x7_config *nc = realloc(l->configs, n * sizeof(*nc));
+			if (!nc) {
+				r = -1;
+				break;
+			}
+			l->configs = nc;
+			l->alloc = n;
+		}
+		l->configs[l->nr++] = c;
+	}
+
+	free(line);
+	if (f != stdin)
+		fclose(f);
+	return r;
+}
+
+void config_list_free(struct config_list *l)
+{
+	free(l->configs);
+	l->configs = NULL;
+	l->nr = l->alloc = 0;
+}
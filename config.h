@@ -0,0 +1,37 @@
+#ifndef CATALOG_CONFIG_H_
+#define CATALOG_CONFIG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The parts of a perf hv_24x7 event config that identify a counter. perf
+ * packs them into perf_event_attr.config as domain (bits 0-3) and offset
+ * (bits 32-63), with the starting index in between.
+ */
+struct hv_24x7_config {
+	unsigned domain;
+	uint32_t offset;
+};
+
+/*
+ * Parse @s, which holds either "domain=0x2,offset=0x358,..." terms (as
+ * `perf evlist` names events), a "config: 0x..." or "config = 0x..." field
+ * (as `perf evlist -v` and `perf report --header-only` print them), or
+ * just a raw config value. Returns 0, or -1 if @s holds none of those.
+ */
+int hv_24x7_config_parse(const char *s, struct hv_24x7_config *c);
+
+struct config_list {
+	struct hv_24x7_config *configs;
+	size_t nr, alloc;
+};
+
+/*
+ * Add the config on each line of @file ('-' is stdin). Lines that don't
+ * hold one are warned about and skipped. Returns 0, or -1 with errno set.
+ */
+int config_list_add_from(struct config_list *l, const char *file);
+void config_list_free(struct config_list *l);
+
+#endif
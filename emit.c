@@ -0,0 +1,230 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+
+#include <ccan/err/err.h>
+#include <ccan/endian/endian.h>
+
+#include "model.h"
+#include "emit.h"
+
+bool emit_c_prefix_is_valid(const char *prefix)
+{
+	const char *c;
+
+	if (!*prefix || isdigit((unsigned char)*prefix))
+		return false;
+	for (c = prefix; *c; c++)
+		if (!isalnum((unsigned char)*c) && *c != '_')
+			return false;
+	return true;
+}
+
+/* Escape everything that isn't plainly printable (and '?', for trigraphs) */
+static void print_c_string(const char *s, size_t len, FILE *o)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\')
+			fprintf(o, "\\%c", c);
+		else if (isprint(c) && c != '?')
+			fputc(c, o);
+		else
+			fprintf(o, "\\%03o", c);
+	}
+}
+
+/* A table of integers, a dozen to a line. Empty tables get a 0 placeholder. */
+static void print_table(const char *type, const char *prefix, const char *name,
+		const uint32_t *v, size_t n, FILE *o)
+{
+	size_t i;
+
+	fprintf(o, "static const %s %s_%s[] = {", type, prefix, name);
+	for (i = 0; i < n; i++)
+		fprintf(o, "%s%"PRIu32",", i % 12 ? " " : "\n\t", v[i]);
+	fprintf(o, "%s\n};\n\n", n ? "" : "\n\t0");
+}
+
+/* The hash from model.h, which model_index_event_names() built the tables with */
+static const char lookup_fmt[] =
+"/* Returns the index in %1$s_events of the event called @name, or -1 */\n"
+"static inline int %1$s_find_event(const char *name, size_t len)\n"
+"{\n"
+"	uint64_t h = 0xcbf29ce484222325ULL;\n"
+"	size_t i;\n"
+"\n"
+"	for (i = 0; i < len; i++) {\n"
+"		h ^= (unsigned char)name[i];\n"
+"		h *= 0x100000001b3ULL;\n"
+"	}\n"
+"\n"
+"	h ^= %1$s_name_disp[(h >> 32) %% %2$zu] * 0x9e3779b97f4a7c15ULL;\n"
+"	h ^= h >> 33;\n"
+"	h *= 0xff51afd7ed558ccdULL;\n"
+"	h ^= h >> 33;\n"
+"\n"
+"	const struct %1$s_event *e = &%1$s_events[%1$s_name_slot[h %% %3$zu]];\n"
+"	if (e->name_len != len || memcmp(%1$s_names + e->name, name, len))\n"
+"		return -1;\n"
+"	return e - %1$s_events;\n"
+"}\n";
+
+int emit_c(const struct catalog_model *m, const char *prefix, FILE *o)
+{
+	const struct catalog_events *e = &m->events;
+	size_t i, j, nr_events = 0, names_len = 0, nr_ev_groups = 0, nr_group_evs = 0;
+	const uint16_t *ixs;
+	char *up;
+
+	if (!m->nr_name_slot)
+		return -1;
+
+	uint32_t *ix = malloc(sizeof(*ix) * (m->nr_events + 1));
+	uint32_t *ev_name = malloc(sizeof(*ev_name) * (m->nr_events + 1));
+	uint32_t *group_name = malloc(sizeof(*group_name) * (m->nr_groups + 1));
+	/* membership lists, each at most every group of every event */
+	uint32_t *ev_groups = malloc(sizeof(*ev_groups) * (m->event_group_start[m->nr_events] + 1));
+	uint32_t *group_evs = malloc(sizeof(*group_evs) * (m->group_event_start[m->nr_groups] + 1));
+	uint32_t *slots = malloc(sizeof(*slots) * m->nr_name_slot);
+	up = strdup(prefix);
+	if (!ix || !ev_name || !group_name || !ev_groups || !group_evs || !slots || !up)
+		err(1, "alloc failure");
+
+	for (i = 0; i < m->nr_events; i++)
+		ix[i] = e->skipped[i] ? UINT32_MAX : nr_events++;
+	for (i = 0; up[i]; i++)
+		up[i] = toupper((unsigned char)up[i]);
+
+	fprintf(o, "/*\n"
+		" * hv_24x7 catalog version %"PRIu64" (built %.*s), as generated by\n"
+		" * `parse --emit-c`. Do not edit.\n"
+		" */\n"
+		"#ifndef %s_H_\n"
+		"#define %s_H_\n"
+		"\n"
+		"#include <stddef.h>\n"
+		"#include <stdint.h>\n"
+		"#include <string.h>\n"
+		"\n"
+		"#define %s_VERSION %"PRIu64"ULL\n"
+		"#define %s_NR_EVENTS %zu\n"
+		"#define %s_NR_GROUPS %zu\n"
+		"#define %s_NO_GROUP 0xffff\n"
+		"\n",
+		be_to_cpu(m->p0.version),
+		(int)strnlen((const char *)m->p0.build_time_stamp, sizeof(m->p0.build_time_stamp)),
+		m->p0.build_time_stamp,
+		up, up, up, be_to_cpu(m->p0.version), up, nr_events, up, m->nr_groups, up);
+
+	fprintf(o, "struct %1$s_event {\n"
+		"	uint32_t name;		/* offset in %1$s_names */\n"
+		"	uint16_t name_len;\n"
+		"	uint16_t index;		/* in the catalog */\n"
+		"	uint32_t offset;	/* of the counter, perf's offset= */\n"
+		"	uint8_t domain;\n"
+		"	uint16_t primary_group;	/* %2$s_NO_GROUP if it isn't known */\n"
+		"	uint32_t first_group;	/* in %1$s_event_groups */\n"
+		"	uint16_t nr_groups;\n"
+		"};\n"
+		"\n"
+		"struct %1$s_group {\n"
+		"	uint32_t name;\n"
+		"	uint16_t name_len;\n"
+		"	uint16_t index;\n"
+		"	uint8_t domain;\n"
+		"	uint32_t first_event;	/* in %1$s_group_events */\n"
+		"	uint16_t nr_events;\n"
+		"};\n"
+		"\n", prefix, up);
+
+	/* Every name, nul terminated so they can be used as C strings */
+	fprintf(o, "static const char %s_names[] =", prefix);
+	for (i = 0; i < m->nr_events; i++) {
+		if (ix[i] == UINT32_MAX)
+			continue;
+		size_t len = model_name_len(m, e->name[i]);
+		ev_name[i] = names_len;
+		names_len += len + 1;
+		fprintf(o, "\n\t\"");
+		print_c_string(model_str(m, e->name[i]), len, o);
+		fprintf(o, "\\0\"");
+	}
+	for (i = 0; i < m->nr_groups; i++) {
+		size_t len = model_name_len(m, m->groups[i].name);
+		group_name[i] = names_len;
+		names_len += len + 1;
+		fprintf(o, "\n\t\"");
+		print_c_string(model_str(m, m->groups[i].name), len, o);
+		fprintf(o, "\\0\"");
+	}
+	fprintf(o, ";\n\n");
+
+	fprintf(o, "static const struct %1$s_event %1$s_events[%2$s_NR_EVENTS] = {\n", prefix, up);
+	for (i = 0; i < m->nr_events; i++) {
+		if (ix[i] == UINT32_MAX)
+			continue;
+
+		size_t first = nr_ev_groups, nr = model_event_groups(m, i, &ixs);
+		for (j = 0; j < nr; j++)
+			if (ixs[j] < m->nr_groups)
+				ev_groups[nr_ev_groups++] = ixs[j];
+
+		size_t len = model_name_len(m, e->name[i]);
+		fprintf(o, "\t{ %"PRIu32", %zu, %"PRIu32", %u, %u, %u, %zu, %zu }, /* ",
+			ev_name[i], len, e->index[i],
+			e->counter_offs[i] + e->group_record_offs[i], e->domain[i],
+			e->primary_group_ix[i] < m->nr_groups ? e->primary_group_ix[i] : 0xffff,
+			first, nr_ev_groups - first);
+		print_c_string(model_str(m, e->name[i]), len, o);
+		fprintf(o, " */\n");
+	}
+	fprintf(o, "};\n\n");
+
+	fprintf(o, "static const struct %1$s_group %1$s_groups[] = {\n", prefix);
+	for (i = 0; i < m->nr_groups; i++) {
+		const struct catalog_group *g = &m->groups[i];
+		size_t first = nr_group_evs, nr = model_group_events(m, i, &ixs);
+		for (j = 0; j < nr; j++)
+			if (ixs[j] < m->nr_events && ix[ixs[j]] != UINT32_MAX)
+				group_evs[nr_group_evs++] = ix[ixs[j]];
+
+		fprintf(o, "\t{ %"PRIu32", %zu, %"PRIu32", %u, %zu, %zu },\n",
+			group_name[i], model_name_len(m, g->name), g->index, g->domain,
+			first, nr_group_evs - first);
+	}
+	fprintf(o, "%s};\n\n", m->nr_groups ? "" : "\t{ 0 },\n");
+
+	print_table("uint16_t", prefix, "event_groups", ev_groups, nr_ev_groups, o);
+	print_table("uint16_t", prefix, "group_events", group_evs, nr_group_evs, o);
+
+	for (i = 0; i < m->nr_name_slot; i++)
+		slots[i] = ix[m->name_slot[i]];
+	print_table("uint32_t", prefix, "name_disp", m->name_disp, m->nr_name_disp, o);
+	print_table("uint16_t", prefix, "name_slot", slots, m->nr_name_slot, o);
+
+	fprintf(o, lookup_fmt, prefix, m->nr_name_disp, m->nr_name_slot);
+	fprintf(o, "\n#endif\n");
+
+	free(up);
+	free(slots);
+	free(group_evs);
+	free(ev_groups);
+	free(group_name);
+	free(ev_name);
+	free(ix);
+	return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef CATALOG_EMIT_H_
+#define CATALOG_EMIT_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+
+struct catalog_model;
+
+#define EMIT_C_DEFAULT_PREFIX "hv_24x7_catalog"
+
+/* Is @prefix usable as the start of C identifiers? */
+bool emit_c_prefix_is_valid(const char *prefix);
+
+/*
+ * Write a C header to @o that holds @m as static const tables: the (not
+ * skipped) events with their names, domains and counter offsets, the
+ * groups, membership in both directions, and a perfect hash lookup of
+ * event names. Every identifier starts with @prefix.
+ *
+ * Expects a complete model whose event names and groups are indexed.
+ * Returns 0, or -1 if there are no events or the names have no hash.
+ */
+int emit_c(const struct catalog_model *m, const char *prefix, FILE *o);
+
+#endif
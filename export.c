@@ -0,0 +1,257 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <ccan/endian/endian.h>
+#include <ccan/array_size/array_size.h>
+
+#include <penny/math.h>
+
+#include "model.h"
+#include "export.h"
+
+static uint32_t crc32c_table[256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_init(void)
+{
+	unsigned i, k;
+
+	for (i = 0; i < ARRAY_SIZE(crc32c_table); i++) {
+		uint32_t c = i;
+		for (k = 0; k < 8; k++)
+			c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+		crc32c_table[i] = c;
+	}
+}
+
+uint32_t export_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	pthread_once(&crc32c_once, crc32c_init);
+	crc = ~crc;
+	while (len--)
+		crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static struct export_str export_str(const struct catalog_model *m, catalog_str_id id)
+{
+	const char *s = model_str(m, id);
+	size_t len = model_str_len(m, id);
+
+	while (len && !s[len - 1])
+		len--;
+	return (struct export_str) {
+		.offs = cpu_to_le32(m->strs[id].offs),
+		.len = cpu_to_le32(len),
+	};
+}
+
+static void export_schemas(const struct catalog_model *m, struct export_schema *x)
+{
+	size_t i;
+
+	for (i = 0; i < m->nr_schemas; i++) {
+		const struct catalog_schema *s = &m->schemas[i];
+		x[i] = (struct export_schema) {
+			.index = cpu_to_le32(s->index),
+			.offset = cpu_to_le32(s->offset),
+			.first_field = cpu_to_le32(s->first_field),
+			.nr_fields = cpu_to_le32(s->nr_fields),
+			.length = cpu_to_le16(s->length),
+			.descriptor = cpu_to_le16(s->descriptor),
+			.version_id = cpu_to_le16(s->version_id),
+			.field_entry_count = cpu_to_le16(s->field_entry_count),
+		};
+	}
+}
+
+static void export_fields(const struct catalog_model *m, struct export_field *x)
+{
+	size_t i;
+
+	for (i = 0; i < m->nr_fields; i++) {
+		const struct catalog_schema_field *f = &m->fields[i];
+		x[i] = (struct export_field) {
+			.field_enum = cpu_to_le16(f->field_enum),
+			.offs = cpu_to_le16(f->offs),
+			.length = cpu_to_le16(f->length),
+			.flags = cpu_to_le16(f->flags),
+		};
+	}
+}
+
+static void export_groups(const struct catalog_model *m, struct export_group *x)
+{
+	size_t i, j;
+
+	for (i = 0; i < m->nr_groups; i++) {
+		const struct catalog_group *g = &m->groups[i];
+		x[i] = (struct export_group) {
+			.index = cpu_to_le32(g->index),
+			.offset = cpu_to_le32(g->offset),
+			.flags = cpu_to_le32(g->flags),
+			.length = cpu_to_le16(g->length),
+			.event_group_record_offs = cpu_to_le16(g->group_record_offs),
+			.event_group_record_len = cpu_to_le16(g->group_record_len),
+			.domain = g->domain,
+			.group_schema_index = g->schema_ix,
+			.event_count = g->event_count,
+			.name = export_str(m, g->name),
+			.desc = export_str(m, g->desc),
+		};
+		for (j = 0; j < ARRAY_SIZE(g->event_ixs); j++)
+			x[i].event_indexes[j] = cpu_to_le16(g->event_ixs[j]);
+	}
+}
+
+static void export_events(const struct catalog_model *m, struct export_event *x)
+{
+	const struct catalog_events *e = &m->events;
+	size_t i;
+
+	for (i = 0; i < m->nr_events; i++) {
+		x[i] = (struct export_event) {
+			.index = cpu_to_le32(e->index[i]),
+			.offset = cpu_to_le32(e->offset[i]),
+			.flags = cpu_to_le32(e->flags[i]),
+			.length = cpu_to_le16(e->length[i]),
+			.event_group_record_offs = cpu_to_le16(e->group_record_offs[i]),
+			.event_group_record_len = cpu_to_le16(e->group_record_len[i]),
+			.event_counter_offs = cpu_to_le16(e->counter_offs[i]),
+			.primary_group_ix = cpu_to_le16(e->primary_group_ix[i]),
+			.group_count = cpu_to_le16(e->group_count[i]),
+			.domain = e->domain[i],
+			.skipped = e->skipped[i],
+			.name = export_str(m, e->name[i]),
+			.desc = export_str(m, e->desc[i]),
+			.detailed_desc = export_str(m, e->long_desc[i]),
+		};
+	}
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	while (len) {
+		ssize_t r = write(fd, buf, len);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += r;
+		len -= r;
+	}
+	return 0;
+}
+
+int catalog_export(const struct catalog_model *m, const char *path)
+{
+	struct {
+		enum export_section_id id;
+		size_t entry_bytes, count;
+	} sections[] = {
+		{ EXPORT_STRINGS, 1, m->strtab_len },
+		{ EXPORT_SCHEMAS, sizeof(struct export_schema), m->nr_schemas },
+		{ EXPORT_FIELDS, sizeof(struct export_field), m->nr_fields },
+		{ EXPORT_GROUPS, sizeof(struct export_group), m->nr_groups },
+		{ EXPORT_EVENTS, sizeof(struct export_event), m->nr_events },
+	};
+	size_t offs[ARRAY_SIZE(sections)];
+	size_t bytes = sizeof(struct export_header)
+		+ ARRAY_SIZE(sections) * sizeof(struct export_section);
+	unsigned i;
+	char *tmp;
+	int e;
+
+	for (i = 0; i < ARRAY_SIZE(sections); i++) {
+		offs[i] = bytes = ALIGN(bytes, 8);
+		bytes += sections[i].count * sections[i].entry_bytes;
+	}
+
+	/* built whole in memory, it is only about the size of the catalog */
+	void *img = calloc(1, bytes);
+	if (!img)
+		return -1;
+
+	memcpy(img + offs[0], m->strtab, m->strtab_len);
+	export_schemas(m, img + offs[1]);
+	export_fields(m, img + offs[2]);
+	export_groups(m, img + offs[3]);
+	export_events(m, img + offs[4]);
+
+	struct export_header *h = img;
+	struct export_section *dir = img + sizeof(*h);
+	for (i = 0; i < ARRAY_SIZE(sections); i++) {
+		size_t n = sections[i].count * sections[i].entry_bytes;
+		dir[i] = (struct export_section) {
+			.id = cpu_to_le32(sections[i].id),
+			.entry_bytes = cpu_to_le32(sections[i].entry_bytes),
+			.offs = cpu_to_le64(offs[i]),
+			.count = cpu_to_le64(sections[i].count),
+			.crc = cpu_to_le32(export_crc32c(0, img + offs[i], n)),
+		};
+	}
+
+	memcpy(h->magic, EXPORT_MAGIC, sizeof(h->magic));
+	h->version = cpu_to_le32(EXPORT_VERSION);
+	h->header_bytes = cpu_to_le32(sizeof(*h));
+	h->file_bytes = cpu_to_le64(bytes);
+	h->nr_sections = cpu_to_le32(ARRAY_SIZE(sections));
+	h->section_bytes = cpu_to_le32(sizeof(*dir));
+	h->catalog_length = cpu_to_le32(be_to_cpu(m->p0.length));
+	h->catalog_version = cpu_to_le64(be_to_cpu(m->p0.version));
+	memcpy(h->build_time_stamp, m->p0.build_time_stamp, sizeof(h->build_time_stamp));
+	h->crc = cpu_to_le32(export_crc32c(0, img, sizeof(*h) + ARRAY_SIZE(sections) * sizeof(*dir)));
+
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0) {
+		free(img);
+		return -1;
+	}
+
+	/* write to a temporary and rename() so readers never see a partial file */
+	int fd = mkstemp(tmp);
+	if (fd < 0)
+		goto err;
+	fchmod(fd, 0644);
+	if (write_all(fd, img, bytes)) {
+		e = errno;
+		close(fd);
+		goto err_unlink;
+	}
+	if (close(fd) || rename(tmp, path)) {
+		e = errno;
+		goto err_unlink;
+	}
+
+	free(tmp);
+	free(img);
+	return 0;
+
+err_unlink:
+	unlink(tmp);
+	errno = e;
+err:
+	e = errno;
+	free(tmp);
+	free(img);
+	errno = e;
+	return -1;
+}
@@ -0,0 +1,137 @@
+#ifndef CATALOG_EXPORT_H_
+#define CATALOG_EXPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define __packed __attribute__((__packed__))
+#include "hv-24x7-catalog.h"
+
+struct catalog_model;
+
+/*
+ * A decoded catalog for tools in other languages, made to be mapped and
+ * used in place: unlike a cache file (which is the model's own tables, in
+ * native byte order) everything here is little endian and of fixed width,
+ * and no struct has padding the compiler chose.
+ *
+ *	struct export_header
+ *	struct export_section	nr_sections of them, the directory
+ *	the sections, each 8 byte aligned, where the directory says
+ *
+ * Readers look sections up by id and skip ids they don't know. Adding a
+ * section, or a field in place of a reserved one, keeps the version; any
+ * other change bumps it. Every section has a CRC-32C (the Castagnoli CRC:
+ * Go's crc32.Castagnoli, SSE 4.2's crc32 instruction), and the header has
+ * one covering itself and the directory.
+ */
+#define EXPORT_MAGIC "24x7dcat"
+#define EXPORT_VERSION 1
+
+struct export_header {
+	char magic[8];			/* EXPORT_MAGIC, not nul terminated */
+	__le32 version;
+	__le32 header_bytes;		/* where the directory starts */
+	__le64 file_bytes;
+	__le32 nr_sections;
+	__le32 section_bytes;		/* of each directory entry */
+	__le32 crc;			/* of the header, with this zeroed, then the directory */
+	__le32 catalog_length;		/* page 0's, in pages */
+	__le64 catalog_version;
+	__u8 build_time_stamp[16];	/* "YYYYMMDDHHMMSS\0\0" */
+} __packed;
+
+enum export_section_id {
+	EXPORT_STRINGS = 1,	/* entries are bytes: nul terminated strings */
+	EXPORT_SCHEMAS,		/* struct export_schema */
+	EXPORT_FIELDS,		/* struct export_field, the schemas' field entries */
+	EXPORT_GROUPS,		/* struct export_group */
+	EXPORT_EVENTS,		/* struct export_event */
+};
+
+struct export_section {
+	__le32 id;		/* enum export_section_id */
+	__le32 entry_bytes;
+	__le64 offs;		/* from the start of the file */
+	__le64 count;		/* of entries */
+	__le32 crc;		/* of the count * entry_bytes bytes at offs */
+	__le32 reserved;
+} __packed;
+
+/* A string of the string section; @len leaves out any nul padding */
+struct export_str {
+	__le32 offs;
+	__le32 len;
+} __packed;
+
+/*
+ * Records are listed in catalog order. Their index is their position in
+ * their section of the catalog, and offset is their byte offset within it;
+ * these only differ from the position in the table when records could not
+ * be decoded. Field names follow the catalog's (see hv-24x7-catalog.h).
+ */
+struct export_schema {
+	__le32 index;
+	__le32 offset;
+	__le32 first_field;		/* in EXPORT_FIELDS */
+	__le32 nr_fields;		/* that fit in length, may be < field_entry_count */
+	__le16 length;
+	__le16 descriptor;
+	__le16 version_id;
+	__le16 field_entry_count;
+} __packed;
+
+struct export_field {
+	__le16 field_enum;
+	__le16 offs;
+	__le16 length;
+	__le16 flags;
+} __packed;
+
+struct export_group {
+	__le32 index;
+	__le32 offset;
+	__le32 flags;
+	__le16 length;
+	__le16 event_group_record_offs;
+	__le16 event_group_record_len;
+	__u8 domain;
+	__u8 group_schema_index;
+	__u8 event_count;
+	__u8 reserved[3];
+	__le16 event_indexes[16];	/* unused ones are 0xffff */
+	struct export_str name;
+	struct export_str desc;
+} __packed;
+
+struct export_event {
+	__le32 index;
+	__le32 offset;
+	__le32 flags;
+	__le16 length;
+	__le16 event_group_record_offs;
+	__le16 event_group_record_len;
+	__le16 event_counter_offs;	/* perf's offset= is this plus event_group_record_offs */
+	__le16 primary_group_ix;
+	__le16 group_count;
+	__u8 domain;
+	__u8 skipped;			/* no data: only index, offset and length are set */
+	__u8 reserved[6];
+	struct export_str name;
+	struct export_str desc;
+	struct export_str detailed_desc;
+} __packed;
+
+/*
+ * CRC-32C of @len bytes at @buf, carrying on from @crc (0 to start). For
+ * checking an export as well as writing one.
+ */
+uint32_t export_crc32c(uint32_t crc, const void *buf, size_t len);
+
+/*
+ * Write @m to @path (by way of a temporary, so readers never see part of
+ * one). Returns 0, or -1 with errno set.
+ */
+int catalog_export(const struct catalog_model *m, const char *path);
+
+#endif
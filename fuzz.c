@@ -0,0 +1,189 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+/*
+ * libFuzzer entry point: the fuzzer's bytes are taken as a catalog and
+ * walked by the same walkers (walk.h) parse uses, three ways: whole and
+ * salvaging, as parse_file() does with --salvage, then indexed and packed;
+ * page by page, as parse_stream() does; and through a window topped up
+ * with pread(), as parse_windowed() does. Nothing is printed, but the
+ * walkers warn about every damaged record, so silence stderr.
+ *
+ *	make fuzz-catalog
+ *	mkdir corpus && ./fuzz-catalog -close_fd_mask=2 -max_len=262144 corpus test-data
+ *
+ * test-data (v3 and empty_catalog) seeds it. Expect roughly 1000 execs/sec
+ * or better on one core with the sanitizers in; much less means something
+ * has stopped being linear in the size of the catalog.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <ccan/endian/endian.h>
+
+#include "catalog.h"
+#include "check.h"
+#include "model.h"
+#include "text.h"
+#include "compact.h"
+#include "walk.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/*
+ * Also holds the walk to ending up in the same place whether or not it
+ * has events_check()'s verdicts to go on.
+ */
+static void walk_whole(struct catalog *c, struct catalog_model *m)
+{
+	struct section_walk w;
+
+#define WALK(sec, walker) do {						\
+		w = (struct section_walk)SECTION_WALK_INIT(c->sec, NULL, NULL); \
+		w.salvage = true;					\
+		walker(&w, m, c->sec.data, c->sec.bytes, true);		\
+	} while (0)
+
+	WALK(schema, walk_schemas);
+	WALK(group, walk_groups);
+#undef WALK
+
+	size_t nr_checks = 0;
+	struct event_check *checks = events_check(c->event.data, c->event.bytes,
+			c->event.entry_count, 1, &nr_checks);
+	struct section_walk checked = SECTION_WALK_INIT(c->event, NULL, NULL);
+	checked.salvage = true;
+	checked.checks = checks;
+	checked.nr_checks = nr_checks;
+	walk_events(&checked, m, c->event.data, c->event.bytes, true);
+	free(checks);
+
+	size_t rows = m->nr_events;
+	w = (struct section_walk)SECTION_WALK_INIT(c->event, NULL, NULL);
+	w.salvage = true;
+	w.keep = false;
+	walk_events(&w, m, c->event.data, c->event.bytes, true);
+	if (w.i != checked.i || w.offset != checked.offset
+			|| w.skipped_records != checked.skipped_records || m->nr_events != rows)
+		abort();
+}
+
+/* Each section's pages in order, though catalog_stream() would interleave them by file order */
+static void walk_streamed(struct catalog *c, struct catalog_model *m, struct xref_seen *seen)
+{
+	struct walk_stream s;
+	unsigned id;
+
+	memset(&s, 0, sizeof(s));
+	s.walk[CATALOG_SCHEMA] = (struct section_walk)SECTION_WALK_INIT(c->schema, NULL, NULL);
+	s.walk[CATALOG_GROUP] = (struct section_walk)SECTION_WALK_INIT(c->group, NULL, NULL);
+	s.walk[CATALOG_EVENT] = (struct section_walk)SECTION_WALK_INIT(c->event, NULL, NULL);
+	s.walk[CATALOG_FORMULA] = (struct section_walk)SECTION_WALK_INIT(c->formula, NULL, NULL);
+	s.walk[CATALOG_EVENT].keep = false;
+	s.walk[CATALOG_SCHEMA].seen = s.walk[CATALOG_EVENT].seen = seen;
+	s.m = m;
+
+	for (id = 0; id < CATALOG_SECTION_COUNT; id++) {
+		struct catalog_section *sec = id == CATALOG_SCHEMA ? &c->schema
+			: id == CATALOG_GROUP ? &c->group
+			: id == CATALOG_EVENT ? &c->event : &c->formula;
+		size_t offs;
+
+		for (offs = 0; offs < sec->bytes; offs += CATALOG_PAGE_SIZE)
+			if (walk_stream_page(&s, id, sec->data + offs,
+					offs + CATALOG_PAGE_SIZE >= sec->bytes))
+				break;
+		catalog_window_free(&s.win[id]);
+	}
+}
+
+/* The catalog, as a file for catalog_window_pread() */
+static int catalog_fd = -1;
+
+static void walk_windowed_all(struct catalog *c, struct catalog_model *m,
+		struct xref_seen *seen, const void *data, size_t size)
+{
+	struct catalog_window win;
+
+	if (catalog_fd < 0)
+		catalog_fd = memfd_create("catalog", 0);
+	if (catalog_fd < 0 || ftruncate(catalog_fd, 0)
+			|| pwrite(catalog_fd, data, size, 0) != (ssize_t)size)
+		abort();
+	if (catalog_window_init(&win, CATALOG_WINDOW_MIN))
+		return;
+
+#define WALK(id, n) do {							\
+		struct section_walk w = SECTION_WALK_INIT(c->n, NULL, NULL);	\
+		w.keep = id == CATALOG_GROUP;					\
+		if (id != CATALOG_GROUP)					\
+			w.seen = seen;						\
+		if (walk_windowed(catalog_fd, id, be_to_cpu(c->p0->n##_data_offs), &w, m, &win)) \
+			goto out;						\
+	} while (0)
+
+	WALK(CATALOG_SCHEMA, schema);
+	WALK(CATALOG_GROUP, group);
+	WALK(CATALOG_EVENT, event);
+#undef WALK
+out:
+	catalog_window_free(&win);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct catalog c;
+	struct catalog_model m;
+	struct catalog_compact cm;
+	struct xref_report r;
+	struct xref_seen seen;
+
+	void *buf = malloc(size ? size : 1);
+	if (!buf)
+		return 0;
+	memcpy(buf, data, size);
+	if (catalog_adopt(&c, buf, size, CATALOG_ALL_SECTIONS))
+		return 0;
+	if (!catalog_page0_is_valid(c.p0))
+		goto out;
+
+	model_init(&m, c.p0);
+	model_reserve(&m, CATALOG_ALL_SECTIONS);
+	walk_whole(&c, &m);
+
+	model_index_event_names(&m);
+	model_index_groups(&m);
+	model_check_xrefs(&m, CATALOG_ALL_SECTIONS, &r);
+	model_index_counters(&m);
+	text_index_build(&m);
+	if (!compact_build(&cm, &m))
+		compact_free(&cm);
+
+	model_reset(&m, c.p0);
+	xref_seen_init(&seen, c.p0);
+	walk_streamed(&c, &m, &seen);
+	xref_check(&seen, &m, CATALOG_ALL_SECTIONS, &r);
+	xref_seen_free(&seen);
+
+	model_reset(&m, c.p0);
+	xref_seen_init(&seen, c.p0);
+	walk_windowed_all(&c, &m, &seen, data, size);
+	xref_check(&seen, &m, CATALOG_ALL_SECTIONS, &r);
+	xref_seen_free(&seen);
+	model_free(&m);
+out:
+	catalog_close(&c);
+	return 0;
+}
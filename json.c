@@ -0,0 +1,236 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ccan/array_size/array_size.h>
+#include <ccan/endian/endian.h>
+
+#include "json.h"
+
+static const char *const domain_names[] = {
+#define DOMAIN(n, v, x) [v] = #n,
+#include "hv-24x7-domains.h"
+#undef DOMAIN
+};
+
+/* The letter of each two character escape, 0 for bytes kept as they are */
+static const char short_escape[256] = {
+	['"'] = '"', ['\\'] = '\\', ['\b'] = 'b', ['\f'] = 'f',
+	['\n'] = 'n', ['\r'] = 'r', ['\t'] = 't',
+};
+
+static bool needs_escape(unsigned char c)
+{
+	return c < 0x20 || c > 0x7f || short_escape[c];
+}
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS (ONES * 0x80)
+
+/*
+ * Do any of the 8 bytes of @w need escaping? The usual "has a byte less
+ * than n" test, for 0x20 and for '"' and '\\' (xored to 0), plus the high
+ * bits for bytes past 0x7f. Borrows can flag bytes wrongly, but only after
+ * one that is rightly flagged.
+ */
+static bool word_needs_escape(uint64_t w)
+{
+	uint64_t q = w ^ (ONES * '"'), b = w ^ (ONES * '\\');
+
+	return (((w - ONES * 0x20) & ~w)
+		| ((q - ONES) & ~q)
+		| ((b - ONES) & ~b)
+		| w) & HIGHS;
+}
+
+static void out_escape(struct out *ob, unsigned char c)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *p = out_reserve(ob, 6);
+
+	if (short_escape[c]) {
+		p[0] = '\\';
+		p[1] = short_escape[c];
+		ob->len += 2;
+		return;
+	}
+
+	memcpy(p, "\\u00", 4);
+	p[4] = hex[c >> 4];
+	p[5] = hex[c & 0xf];
+	ob->len += 6;
+}
+
+void json_string(struct out *ob, const void *s, size_t len)
+{
+	const unsigned char *p = s;
+
+	while (len && !p[len - 1])
+		len--;
+
+	out_char(ob, '"');
+	while (len) {
+		size_t run = 0;
+		uint64_t w;
+
+		/* most strings are plain text, check them a word at a time */
+		for (; run + sizeof(w) <= len; run += sizeof(w)) {
+			memcpy(&w, p + run, sizeof(w));
+			if (word_needs_escape(w))
+				break;
+		}
+		while (run < len && !needs_escape(p[run]))
+			run++;
+
+		out_bytes(ob, p, run);
+		p += run;
+		len -= run;
+		if (!len)
+			break;
+
+		out_escape(ob, *p);
+		p++;
+		len--;
+	}
+	out_char(ob, '"');
+}
+
+/* Members after the first: @k is a string literal, written with a leading comma */
+static void json_dec(struct out *ob, const char *key, size_t key_len, uint64_t v)
+{
+	out_bytes(ob, key, key_len);
+	out_dec(ob, v);
+}
+#define JSON_DEC(ob, k, v) json_dec(ob, ",\"" k "\":", sizeof(",\"" k "\":") - 1, v)
+#define JSON_KEY(ob, k) out_lit(ob, ",\"" k "\":")
+
+static void json_model_str(struct out *ob, const struct catalog_model *m, catalog_str_id id)
+{
+	json_string(ob, model_str(m, id), model_str_len(m, id));
+}
+
+static void json_domain(struct out *ob, unsigned domain)
+{
+	JSON_DEC(ob, "domain", domain);
+	JSON_KEY(ob, "domain_name");
+	if (domain < ARRAY_SIZE(domain_names) && domain_names[domain])
+		json_string(ob, domain_names[domain], strlen(domain_names[domain]));
+	else
+		out_lit(ob, "null");
+}
+
+void json_catalog(struct out *ob, const char *file, const struct hv_24x7_catalog_page_0 *p0)
+{
+	out_lit(ob, "{\"type\":\"catalog\"");
+	if (file) {
+		JSON_KEY(ob, "file");
+		json_string(ob, file, strlen(file));
+	}
+	JSON_DEC(ob, "length", be_to_cpu(p0->length));
+	JSON_DEC(ob, "version", be_to_cpu(p0->version));
+	JSON_KEY(ob, "build_time_stamp");
+	json_string(ob, p0->build_time_stamp, sizeof(p0->build_time_stamp));
+	JSON_DEC(ob, "schema_data_offs", be_to_cpu(p0->schema_data_offs));
+	JSON_DEC(ob, "schema_data_len", be_to_cpu(p0->schema_data_len));
+	JSON_DEC(ob, "schema_entry_count", be_to_cpu(p0->schema_entry_count));
+	JSON_DEC(ob, "event_data_offs", be_to_cpu(p0->event_data_offs));
+	JSON_DEC(ob, "event_data_len", be_to_cpu(p0->event_data_len));
+	JSON_DEC(ob, "event_entry_count", be_to_cpu(p0->event_entry_count));
+	JSON_DEC(ob, "group_data_offs", be_to_cpu(p0->group_data_offs));
+	JSON_DEC(ob, "group_data_len", be_to_cpu(p0->group_data_len));
+	JSON_DEC(ob, "group_entry_count", be_to_cpu(p0->group_entry_count));
+	JSON_DEC(ob, "formula_data_offs", be_to_cpu(p0->formula_data_offs));
+	JSON_DEC(ob, "formula_data_len", be_to_cpu(p0->formula_data_len));
+	JSON_DEC(ob, "formula_entry_count", be_to_cpu(p0->formula_entry_count));
+	out_lit(ob, "}\n");
+}
+
+void json_schema(struct out *ob, const struct catalog_model *m, const struct catalog_schema *schema)
+{
+	size_t i;
+
+	out_lit(ob, "{\"type\":\"schema\"");
+	JSON_DEC(ob, "index", schema->index);
+	JSON_DEC(ob, "offset", schema->offset);
+	JSON_DEC(ob, "length", schema->length);
+	JSON_DEC(ob, "descriptor", schema->descriptor);
+	JSON_DEC(ob, "version_id", schema->version_id);
+	JSON_DEC(ob, "field_entry_count", schema->field_entry_count);
+	JSON_KEY(ob, "field_entries");
+	out_char(ob, '[');
+	for (i = 0; i < schema->nr_fields; i++) {
+		const struct catalog_schema_field *field = &m->fields[schema->first_field + i];
+		if (i)
+			out_char(ob, ',');
+		out_lit(ob, "{\"enum\":");
+		out_dec(ob, field->field_enum);
+		JSON_DEC(ob, "offs", field->offs);
+		JSON_DEC(ob, "length", field->length);
+		JSON_DEC(ob, "flags", field->flags);
+		out_char(ob, '}');
+	}
+	out_lit(ob, "]}\n");
+}
+
+void json_group(struct out *ob, const struct catalog_model *m, const struct catalog_group *group)
+{
+	size_t i;
+
+	out_lit(ob, "{\"type\":\"group\"");
+	JSON_DEC(ob, "index", group->index);
+	JSON_DEC(ob, "offset", group->offset);
+	JSON_DEC(ob, "length", group->length);
+	JSON_DEC(ob, "flags", group->flags);
+	json_domain(ob, group->domain);
+	JSON_DEC(ob, "event_group_record_offs", group->group_record_offs);
+	JSON_DEC(ob, "event_group_record_len", group->group_record_len);
+	JSON_DEC(ob, "group_schema_index", group->schema_ix);
+	JSON_DEC(ob, "event_count", group->event_count);
+	JSON_KEY(ob, "event_indexes");
+	out_char(ob, '[');
+	for (i = 0; i < ARRAY_SIZE(group->event_ixs); i++) {
+		if (i)
+			out_char(ob, ',');
+		out_dec(ob, group->event_ixs[i]);
+	}
+	out_char(ob, ']');
+	JSON_KEY(ob, "name");
+	json_model_str(ob, m, group->name);
+	JSON_KEY(ob, "desc");
+	json_model_str(ob, m, group->desc);
+	out_lit(ob, "}\n");
+}
+
+void json_event(struct out *ob, const struct catalog_model *m, size_t ev)
+{
+	const struct catalog_events *e = &m->events;
+
+	out_lit(ob, "{\"type\":\"event\"");
+	JSON_DEC(ob, "index", e->index[ev]);
+	JSON_DEC(ob, "offset", e->offset[ev]);
+	JSON_DEC(ob, "length", e->length[ev]);
+	json_domain(ob, e->domain[ev]);
+	JSON_DEC(ob, "event_group_record_offs", e->group_record_offs[ev]);
+	JSON_DEC(ob, "event_group_record_len", e->group_record_len[ev]);
+	JSON_DEC(ob, "event_counter_offs", e->counter_offs[ev]);
+	JSON_DEC(ob, "flags", e->flags[ev]);
+	JSON_DEC(ob, "primary_group_ix", e->primary_group_ix[ev]);
+	JSON_DEC(ob, "group_count", e->group_count[ev]);
+	JSON_KEY(ob, "name");
+	json_model_str(ob, m, e->name[ev]);
+	JSON_KEY(ob, "desc");
+	json_model_str(ob, m, e->desc[ev]);
+	JSON_KEY(ob, "detailed_desc");
+	json_model_str(ob, m, e->long_desc[ev]);
+	out_lit(ob, "}\n");
+}
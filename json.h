@@ -0,0 +1,31 @@
+#ifndef CATALOG_JSON_H_
+#define CATALOG_JSON_H_
+
+#include <stddef.h>
+
+#define __packed __attribute__((__packed__))
+#include "hv-24x7-catalog.h"
+#include "model.h"
+#include "out.h"
+
+/*
+ * The catalog as JSON Lines: an object per line, so records can be read
+ * as they are written, each with a "type" of "catalog" (page 0, which
+ * comes first), "schema", "group" or "event". Fields are named after the
+ * text output's, which are the catalog's own.
+ *
+ * Strings lose their nul padding. Other bytes JSON can't hold as they are
+ * become \u escapes; those past 0x7f are taken to be latin-1, so the output
+ * is valid UTF-8 whatever the catalog holds.
+ */
+
+/* @s (of @len bytes) as a quoted JSON string */
+void json_string(struct out *ob, const void *s, size_t len);
+
+/* @file is named if not NULL */
+void json_catalog(struct out *ob, const char *file, const struct hv_24x7_catalog_page_0 *p0);
+void json_schema(struct out *ob, const struct catalog_model *m, const struct catalog_schema *schema);
+void json_group(struct out *ob, const struct catalog_model *m, const struct catalog_group *group);
+void json_event(struct out *ob, const struct catalog_model *m, size_t ev);
+
+#endif
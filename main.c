@@ -14,6 +14,12 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include <ccan/pr_debug/pr_debug.h>
 #include <ccan/array_size/array_size.h>
@@ -26,6 +32,20 @@
 
 #define __packed __attribute__((__packed__))
 #include "hv-24x7-catalog.h"
+#include "catalog.h"
+#include "model.h"
+#include "cache.h"
+#include "batch.h"
+#include "config.h"
+#include "select.h"
+#include "text.h"
+#include "check.h"
+#include "emit.h"
+#include "compact.h"
+#include "out.h"
+#include "json.h"
+#include "export.h"
+#include "walk.h"
 
 /* 2 mappings:
  * - # to name
@@ -57,124 +77,34 @@ static const char *domain_to_index_string(enum hv_perf_domains domain)
 	}
 }
 
-static size_t domain_to_string(enum hv_perf_domains domain, char *buf, size_t buf_len)
+static void out_domain(struct out *ob, enum hv_perf_domains domain)
 {
-	size_t l;
 	switch (domain) {
 #define DOMAIN(n, v, x)				\
 	case HV_PERF_DOMAIN_##n:		\
-		l = max(strlen(#n), buf_len);	\
-		memcpy(buf, #n, l);		\
+		out_lit(ob, #n);		\
 		break;
 #include "hv-24x7-domains.h"
 #undef DOMAIN
 	default:
-		l = snprintf(buf, buf_len, "unknown[%d]", domain);
+		out_lit(ob, "unknown[");
+		out_dec(ob, domain);
+		out_char(ob, ']');
 	}
-
-	return l;
-}
-
-static char *event_name(struct hv_24x7_event_data *ev, size_t *len)
-{
-	*len = be_to_cpu(ev->event_name_len) - 2;
-	return (char *)ev->remainder;
-}
-
-static char *event_desc(struct hv_24x7_event_data *ev, size_t *len)
-{
-	unsigned nl = be_to_cpu(ev->event_name_len);
-	__be16 *desc_len = (__be16 *)(ev->remainder + nl - 2);
-	*len = be_to_cpu(*desc_len) - 2;
-	return (char *)ev->remainder + nl;
 }
 
-static char *event_long_desc(struct hv_24x7_event_data *ev, size_t *len)
+static void out_event_fmt(struct out *ob, unsigned domain, uint32_t offset)
 {
-	unsigned nl = be_to_cpu(ev->event_name_len);
-	__be16 *desc_len_ = (__be16 *)(ev->remainder + nl - 2);
-	unsigned desc_len = be_to_cpu(*desc_len_);
-	__be16 *long_desc_len = (__be16 *)(ev->remainder + nl + desc_len - 2);
-	*len = be_to_cpu(*long_desc_len) - 2;
-	return (char *)ev->remainder + nl + desc_len;
-}
-
-
-static bool event_fixed_portion_is_within(struct hv_24x7_event_data *ev, void *end)
-{
-	void *start = ev;
-	return (start + offsetof(struct hv_24x7_event_data, remainder)) < end;
-}
-
-/*
- * Things we don't check:
- *  - padding for desc, name, and long/detailed desc is required to be '\0' bytes.
- */
-static bool event_is_within(struct hv_24x7_event_data *ev, void *end)
-{
-	unsigned nl = be_to_cpu(ev->event_name_len);
-	void *start = ev;
-	if (nl < 2) {
-		pr_debug(1, "%s: name length too short: %d", __func__, nl);
-		return false;
-	}
-
-	if (start + nl > end) {
-		pr_debug(1, "%s: start=%p + nl=%u > end=%p", __func__, start, nl, end);
-		return false;
-	}
-
-	__be16 *dl_ = (__be16 *)(ev->remainder + nl - 2);
-	if (!IS_ALIGNED((uintptr_t)dl_, 2))
-		warnx("desc len not aligned %p", dl_);
-	unsigned dl = be_to_cpu(*dl_);
-	if (dl < 2) {
-		pr_debug(1, "%s: desc len too short: %d", __func__, dl);
-		return false;
-	}
-
-	if (start + nl + dl > end) {
-		pr_debug(1, "%s: (start=%p + nl=%u + dl=%u)=%p > end=%p", __func__, start, nl, dl, start + nl + dl, end);
-		return false;
-	}
-
-	__be16 *ldl_ = (__be16 *)(ev->remainder + nl + dl - 2);
-	if (!IS_ALIGNED((uintptr_t)ldl_, 2))
-		warnx("long desc len not aligned %p", ldl_);
-	unsigned ldl = be_to_cpu(*ldl_);
-	if (ldl < 2) {
-		pr_debug(1, "%s: long desc len too short (ldl=%u)", __func__, ldl);
-		return false;
-	}
-
-	if (start + nl + dl + ldl > end) {
-		pr_debug(1, "%s: start=%p + nl=%u + dl=%u + ldl=%u > end=%p", __func__, start, nl, dl, ldl, end);
-		return false;
-	}
-
-	return true;
-}
-
-static char *group_name(struct hv_24x7_group_data *group, size_t *len)
-{
-	*len = be_to_cpu(group->group_name_len) - 2;
-	return (char *)group->remainder;
-}
-
-static void print_event_fmt(struct hv_24x7_event_data *event, unsigned domain, FILE *o)
-{
-	const char *lpar;
+	out_lit(ob, "domain=0x");
+	out_hex(ob, domain);
+	out_lit(ob, ",offset=0x");
+	out_hex(ob, offset);
+	out_lit(ob, ",starting_index=");
+	out_str(ob, domain_to_index_string(domain));
 	if (is_physical_domain(domain))
-		lpar = "0x0";
+		out_lit(ob, ",lpar=0x0\n");
 	else
-		lpar = "sibling_guest_id";
-
-	fprintf(o, "domain=0x%x,offset=0x%x,starting_index=%s,lpar=%s\n",
-			domain,
-			be_to_cpu(event->event_counter_offs) +
-				be_to_cpu(event->event_group_record_offs),
-			domain_to_index_string(domain),
-			lpar);
+		out_lit(ob, ",lpar=sibling_guest_id\n");
 }
 
 static unsigned core_domains[] = {
@@ -185,311 +115,305 @@ static unsigned core_domains[] = {
 	HV_PERF_DOMAIN_VIRTUAL_PROCESSOR_REMOTE_NODE,
 };
 
-static void print_event_for_all_domains(struct hv_24x7_event_data *event, FILE *o)
+/* @name (of @name_len bytes) needn't be nul terminated */
+static void print_event_for_all_domains(struct out *ob, const char *name, size_t name_len,
+		unsigned domain, uint32_t offset)
 {
 	unsigned i;
-	size_t nl;
-	char *name = event_name(event, &nl);
-	fprintf(o, "%.*s:\n", (int)nl, name);
-	switch (event->domain) {
+	out_bytes(ob, name, name_len);
+	out_lit(ob, ":\n");
+	switch (domain) {
 	case HV_PERF_DOMAIN_PHYSICAL_CHIP:
-		print_event_fmt(event, event->domain, o);
+		out_event_fmt(ob, domain, offset);
 		break;
 	case HV_PERF_DOMAIN_PHYSICAL_CORE:
 		for (i = 0; i < ARRAY_SIZE(core_domains); i++)
-			print_event_fmt(event, core_domains[i], o);
+			out_event_fmt(ob, core_domains[i], offset);
 		break;
 	default:
 		pr_debug(1, "Whoops");
 	}
 }
 
-static void print_event(struct hv_24x7_event_data *event, struct hv_24x7_group_data **group_index, size_t group_count, FILE *o)
+/* The catalog domain of the events perf counts in config domain @domain */
+static int config_catalog_domain(unsigned domain)
 {
-	size_t name_len, desc_len, long_desc_len, group_name_len;
-	const char *name, *desc, *long_desc, *group_name_;
-	char domain[1024];
-
-	print_event_for_all_domains(event, o);
-
-	if (!debug_is(5))
-		return;
-
-	name = event_name(event, &name_len);
-	desc = event_desc(event, &desc_len);
-	long_desc = event_long_desc(event, &long_desc_len);
-	size_t group_ix = be_to_cpu(event->primary_group_ix);
-	if (group_ix >= group_count) {
-		group_name_ = "UNKNOWN";
-		group_name_len = strlen(group_name_);
-	} else {
-		group_name_ = group_name(group_index[group_ix], &group_name_len);
-	}
-
-	domain_to_string(event->domain, domain, sizeof(domain));
-
-	fprintf(o, "event {\n"
-		"	.length = %u,\n"
-		"	.domain = %s /* %u */,\n"
-		"	.event_group_record_offs = %u,\n"
-		"	.event_group_record_len = %u,\n"
-		"	.event_counter_offs = %u,\n"
-		"	.flags = %"PRIx32",\n"
-		"	.primary_group_ix = \"",
-		be_to_cpu(event->length),
-		domain, event->domain,
-		be_to_cpu(event->event_group_record_offs),
-		be_to_cpu(event->event_group_record_len),
-		be_to_cpu(event->event_counter_offs),
-		be_to_cpu(event->flags));
-
-	print_bytes_as_cstring_(group_name_, group_name_len, o);
+	unsigned i;
+	if (domain == HV_PERF_DOMAIN_PHYSICAL_CHIP)
+		return domain;
+	for (i = 0; i < ARRAY_SIZE(core_domains); i++)
+		if (core_domains[i] == domain)
+			return HV_PERF_DOMAIN_PHYSICAL_CORE;
+	return -1;
+}
 
-	fprintf(o, "\" /* %u */,\n"
-		"	.group_count = %u,\n"
-		"	.name = \"",
-		be_to_cpu(event->primary_group_ix),
-		be_to_cpu(event->group_count));
+/* A line of the form "\t.@field = @v,\n" */
+static void out_dec_field(struct out *ob, const char *field, size_t field_len, uint64_t v)
+{
+	out_lit(ob, "\t.");
+	out_bytes(ob, field, field_len);
+	out_lit(ob, " = ");
+	out_dec(ob, v);
+	out_lit(ob, ",\n");
+}
+#define OUT_DEC_FIELD(ob, field, v) out_dec_field(ob, field, sizeof(field) - 1, v)
 
-	print_bytes_as_cstring_(name, name_len, o);
+/* The string of a field, then the close of the line, noting its length */
+static void out_str_field(struct out *ob, const struct catalog_model *m, catalog_str_id id)
+{
+	out_cstring(ob, model_str(m, id), model_str_len(m, id));
+	out_lit(ob, "\", /* ");
+	out_dec(ob, model_str_len(m, id));
+	out_lit(ob, " */\n");
+}
 
-	fprintf(o, "\", /* %zu */\n"
-		"	.desc = \"",
-		name_len);
+static void out_event(struct out *ob, const struct catalog_model *m, size_t ev)
+{
+	const struct catalog_events *e = &m->events;
 
-	print_bytes_as_cstring_(desc, desc_len, o);
+	print_event_for_all_domains(ob, model_str(m, e->name[ev]), model_name_len(m, e->name[ev]),
+			e->domain[ev], e->counter_offs[ev] + e->group_record_offs[ev]);
 
-	fprintf(o, "\", /* %zu */\n"
-		"	.detailed_desc = \"",
-		desc_len);
+	if (!debug_is(5))
+		return;
 
-	print_bytes_as_cstring_(long_desc, long_desc_len, o);
+	out_lit(ob, "event {\n");
+	OUT_DEC_FIELD(ob, "length", e->length[ev]);
+	out_lit(ob, "\t.domain = ");
+	out_domain(ob, e->domain[ev]);
+	out_lit(ob, " /* ");
+	out_dec(ob, e->domain[ev]);
+	out_lit(ob, " */,\n");
+	OUT_DEC_FIELD(ob, "event_group_record_offs", e->group_record_offs[ev]);
+	OUT_DEC_FIELD(ob, "event_group_record_len", e->group_record_len[ev]);
+	OUT_DEC_FIELD(ob, "event_counter_offs", e->counter_offs[ev]);
+	out_lit(ob, "\t.flags = ");
+	out_hex(ob, e->flags[ev]);
+	out_lit(ob, ",\n\t.primary_group_ix = \"");
+
+	size_t group_ix = e->primary_group_ix[ev];
+	if (group_ix >= m->nr_groups)
+		out_lit(ob, "UNKNOWN");
+	else
+		out_cstring(ob, model_str(m, m->groups[group_ix].name),
+				model_str_len(m, m->groups[group_ix].name));
+
+	out_lit(ob, "\" /* ");
+	out_dec(ob, group_ix);
+	out_lit(ob, " */,\n");
+	OUT_DEC_FIELD(ob, "group_count", e->group_count[ev]);
+	out_lit(ob, "\t.name = \"");
+	out_str_field(ob, m, e->name[ev]);
+	out_lit(ob, "\t.desc = \"");
+	out_str_field(ob, m, e->desc[ev]);
+	out_lit(ob, "\t.detailed_desc = \"");
+	out_str_field(ob, m, e->long_desc[ev]);
+	out_lit(ob, "}\n");
+}
 
-	fprintf(o, "\", /* %zu */\n"
-		"}\n",
-		long_desc_len);
+static void out_group(struct out *ob, const struct catalog_model *m,
+		const struct catalog_group *group)
+{
+	size_t i;
 
-	if (debug_is(100))
-		print_hex_dump_fmt(event, be_to_cpu(event->length), o);
+	out_lit(ob, "group {\n");
+	OUT_DEC_FIELD(ob, "length", group->length);
+	out_lit(ob, "\t.flags = ");
+	out_hex(ob, group->flags);
+	out_lit(ob, ",\n\t.domain = ");
+	out_domain(ob, group->domain);
+	out_lit(ob, " /* ");
+	out_dec(ob, group->domain);
+	out_lit(ob, " */,\n");
+	OUT_DEC_FIELD(ob, "event_group_record_offs", group->group_record_offs);
+	OUT_DEC_FIELD(ob, "event_group_record_len", group->group_record_len);
+	OUT_DEC_FIELD(ob, "group_schema_index", group->schema_ix);
+	OUT_DEC_FIELD(ob, "event_count", group->event_count);
+	out_lit(ob, "\t.event_indexes = {");
+	for (i = 0; i < ARRAY_SIZE(group->event_ixs); i++) {
+		if (i)
+			out_lit(ob, ", ");
+		out_dec(ob, group->event_ixs[i]);
+	}
+	out_lit(ob, "},\n\t.name = \"");
+	out_str_field(ob, m, group->name);
+	out_lit(ob, "\t.desc = \"");
+	out_str_field(ob, m, group->desc);
+	out_lit(ob, "}\n");
 }
 
-static bool group_fixed_portion_is_within(struct hv_24x7_group_data *group, void *end)
+static void out_schema_field_entry(struct out *ob, const struct catalog_schema_field *field)
 {
-	void *start = group;
-	return (start + sizeof(*group)) < end;
+	out_lit(ob, "\t\t{\n\t\t\t.enum = ");
+	out_dec(ob, field->field_enum);
+	out_lit(ob, ",\n\t\t\t.offs = ");
+	out_dec(ob, field->offs);
+	out_lit(ob, ",\n\t\t\t.length = ");
+	out_dec(ob, field->length);
+	out_lit(ob, ",\n\t\t\t.flags = 0x");
+	out_HEX(ob, field->flags);
+	out_lit(ob, ",\n\t\t},\n");
 }
 
-static bool group_is_within(struct hv_24x7_group_data *group, void *end)
+static void out_schema(struct out *ob, const struct catalog_model *m,
+		const struct catalog_schema *schema)
 {
-	unsigned nl = be_to_cpu(group->group_name_len);
-	void *start = group;
-	if (nl < 2) {
-		pr_debug(1, "%s: name length too short: %d", __func__, nl);
-		return false;
-	}
-
-	if (start + nl > end) {
-		pr_debug(1, "%s: start=%p + nl=%u > end=%p", __func__, start, nl, end);
-		return false;
-	}
+	size_t i;
 
-	unsigned dl = be_to_cpu(*((__be16*)(group->remainder + nl - 2)));
-	if (dl < 2) {
-		pr_debug(1, "%s: desc len too short: %d", __func__, dl);
-		return false;
+	out_lit(ob, "schema {\n");
+	OUT_DEC_FIELD(ob, "length", schema->length);
+	OUT_DEC_FIELD(ob, "descriptor", schema->descriptor);
+	OUT_DEC_FIELD(ob, "version_id", schema->version_id);
+	OUT_DEC_FIELD(ob, "field_entry_count", schema->field_entry_count);
+	out_lit(ob, "\t.field_entries = {\n");
+
+	for (i = 0; i < schema->nr_fields; i++) {
+		out_lit(ob, "\t\t[");
+		out_dec(ob, i);
+		out_lit(ob, "] = ");
+		out_schema_field_entry(ob, &m->fields[schema->first_field + i]);
 	}
 
-	if (start + nl + dl > end) {
-		pr_debug(1, "%s: (start=%p + nl=%u + dl=%u)=%p > end=%p", __func__, start, nl, dl, start + nl + dl, end);
-		return false;
-	}
+	if (i != schema->field_entry_count)
+		warnx("schema ended before listed # of fields were parsed (got %zu, wanted %u, length %u)",
+				i, schema->field_entry_count, schema->length);
 
-	return true;
+	out_lit(ob, "\t}\n"
+		    "}\n");
 }
 
-static char *group_desc(struct hv_24x7_group_data *group, size_t *len)
+/* A record's banner: "@what @i of @count: len=@len offset=@offset", as a comment */
+static void out_banner(struct out *ob, const char *what, size_t i, unsigned count,
+		size_t len, size_t offset)
 {
-	unsigned nl = be_to_cpu(group->group_name_len);
-	__be16 *desc_len = (__be16 *)(group->remainder + nl - 2);
-	*len = be_to_cpu(*desc_len) - 2;
-	return (char *)group->remainder + nl;
+	out_lit(ob, "/* ");
+	out_str(ob, what);
+	out_char(ob, ' ');
+	out_dec(ob, i);
+	out_lit(ob, " of ");
+	out_dec(ob, count);
+	out_lit(ob, ": len=");
+	out_dec(ob, len);
+	out_lit(ob, " offset=");
+	out_dec(ob, offset);
+	out_lit(ob, " */\n");
 }
 
-static void print_group(struct hv_24x7_group_data *group, FILE *o)
+static void out_schema_banner(struct out *ob, size_t i, unsigned count, size_t len, size_t offset)
 {
-	size_t name_len, desc_len;
-	char *name, *desc;
-	char domain[1024];
+	if (debug_is(1))
+		out_banner(ob, "schema", i, count, len, offset);
 
-	domain_to_string(group->domain, domain, sizeof(domain));
-	name = group_name(group, &name_len);
-	desc = group_desc(group, &desc_len);
-
-	fprintf(o, "group {\n"
-		"	.length = %u,\n"
-		"	.flags = %"PRIx32",\n"
-		"	.domain = %s /* %u */,\n"
-		"	.event_group_record_offs = %u,\n"
-		"	.event_group_record_len = %u,\n"
-		"	.group_schema_index = %u,\n"
-		"	.event_count = %u,\n"
-		"	.event_indexes = {%u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u, %u},\n"
-		"	.name = \"",
-		be_to_cpu(group->length),
-		be_to_cpu(group->flags),
-		domain, group->domain,
-		be_to_cpu(group->event_group_record_offs),
-		be_to_cpu(group->event_group_record_len),
-		be_to_cpu(group->group_schema_ix),
-		be_to_cpu(group->event_count),
-		be_to_cpu(group->event_ixs[0]),
-		be_to_cpu(group->event_ixs[1]),
-		be_to_cpu(group->event_ixs[2]),
-		be_to_cpu(group->event_ixs[3]),
-		be_to_cpu(group->event_ixs[4]),
-		be_to_cpu(group->event_ixs[5]),
-		be_to_cpu(group->event_ixs[6]),
-		be_to_cpu(group->event_ixs[7]),
-		be_to_cpu(group->event_ixs[8]),
-		be_to_cpu(group->event_ixs[9]),
-		be_to_cpu(group->event_ixs[10]),
-		be_to_cpu(group->event_ixs[11]),
-		be_to_cpu(group->event_ixs[12]),
-		be_to_cpu(group->event_ixs[13]),
-		be_to_cpu(group->event_ixs[14]),
-		be_to_cpu(group->event_ixs[15]));
+	if (!IS_ALIGNED(len, 16))
+		out_lit(ob, "/* missaligned */\n");
+}
 
-	print_bytes_as_cstring_(name, name_len, o);
+static void out_group_banner(struct out *ob, size_t i, unsigned count, size_t len, size_t offset)
+{
+	pr_debug(1, "/* group %zu of %u: len=%zu offset=%zu */\n", i, count, len, offset);
 
-	fprintf(o , "\", /* %zu */\n"
-		"	.desc = \"", name_len);
+	if (!IS_ALIGNED(len, 16))
+		out_lit(ob, "/* missaligned */\n");
+}
 
-	print_bytes_as_cstring_(desc, desc_len, o);
+static void out_event_banner(struct out *ob, size_t i, unsigned count, size_t len, size_t offset)
+{
+	out_banner(ob, "event", i, count, len, offset);
 
-	fprintf(o, "\", /* %zu */\n"
-		"}\n", desc_len);
+	if (!IS_ALIGNED(len, 16))
+		out_lit(ob, "/* missaligned */\n");
 }
 
-static bool schema_fixed_portion_is_within(struct hv_24x7_grs *schema, void *end)
+/*
+ * The walkers hand each banner and record to the FILE as soon as it is
+ * formatted, so they stay in step with any warnings about the record.
+ */
+#define PRINT_VIA_OUT(o, fn, ...) do {		\
+	struct out *ob_ = out_start(o);		\
+	(fn)(ob_, __VA_ARGS__);			\
+	out_end(ob_);				\
+} while (0)
+
+/* @raw is the undecoded record of event @ev, if it is still around */
+static void print_event(const struct catalog_model *m, size_t ev,
+		const void *raw, FILE *o)
 {
-	void *start = schema;
-	return (start + sizeof(*schema)) < end;
+	PRINT_VIA_OUT(o, out_event, m, ev);
+
+	if (debug_is(100) && raw)
+		print_hex_dump_fmt(raw, m->events.length[ev], o);
 }
 
-static bool schema_is_within(struct hv_24x7_grs *schema, void *end)
+/* The walkers' printers (see struct walk_printer): as text, and as JSON */
+static void print_walk_banner(const struct section_walk *w, enum catalog_section_id id,
+		size_t len, size_t offset)
 {
-	unsigned field_entry_count = be_to_cpu(schema->field_entry_count);
-	void *start = schema;
-	if (!field_entry_count) {
-		pr_debug(1, "%s: no field entries", __func__);
-		return false;
+	switch (id) {
+	case CATALOG_SCHEMA:
+		PRINT_VIA_OUT(w->o, out_schema_banner, w->i, w->count, len, offset);
+		break;
+	case CATALOG_GROUP:
+		PRINT_VIA_OUT(w->o, out_group_banner, w->i, w->count, len, offset);
+		break;
+	case CATALOG_EVENT:
+		PRINT_VIA_OUT(w->o, out_event_banner, w->i, w->count, len, offset);
+		break;
+	default:
+		break;
 	}
+}
 
-	size_t field_entry_bytes = field_entry_count * sizeof(schema->field_entrys[0]);
-
-	if (start + field_entry_bytes > end) {
-		pr_debug(1, "%s: start=%p + field_entry_bytes=%zu > end=%p", __func__, start, field_entry_bytes, end);
-		return false;
+static void print_walk_record(const struct section_walk *w, const struct catalog_model *m,
+		enum catalog_section_id id, size_t row, const void *raw)
+{
+	switch (id) {
+	case CATALOG_SCHEMA:
+		PRINT_VIA_OUT(w->o, out_schema, m, &m->schemas[row]);
+		break;
+	case CATALOG_GROUP:
+		PRINT_VIA_OUT(w->o, out_group, m, &m->groups[row]);
+		break;
+	case CATALOG_EVENT:
+		print_event(m, row, raw, w->o);
+		break;
+	default:
+		break;
 	}
-
-	return true;
 }
 
-static void print_schema_field_entry(struct hv_24x7_grs_field *field, FILE *o)
+static void print_walk_json(const struct section_walk *w, const struct catalog_model *m,
+		enum catalog_section_id id, size_t row, const void *raw)
 {
-	fprintf(o, "		{\n"
-		"			.enum = %u,\n"
-		"			.offs = %u,\n"
-		"			.length = %u,\n"
-		"			.flags = 0x%X,\n"
-		"		},\n",
-		be_to_cpu(field->field_enum),
-		be_to_cpu(field->offs),
-		be_to_cpu(field->length),
-		be_to_cpu(field->flags));
-}
-
-static void print_schema(struct hv_24x7_grs *schema, FILE *o)
-{
-	size_t length = be_to_cpu(schema->length);
-	size_t field_entry_count = be_to_cpu(schema->field_entry_count);
-
-	fprintf(o, "schema {\n"
-		"	.length = %zu,\n"
-		"	.descriptor = %u,\n"
-		"	.version_id = %u,\n"
-		"	.field_entry_count = %zu,\n"
-		"	.field_entries = {\n",
-		length,
-		be_to_cpu(schema->descriptor),
-		be_to_cpu(schema->version_id),
-		field_entry_count);
-
-	struct hv_24x7_grs_field *field = (void *)schema->field_entrys;
-	size_t i = 0;
-	size_t offset;
-	for (;;) {
-		offset = (void *)field - (void *)schema;
-		if (offset >= length)
-			break;
-
-		if (i >= field_entry_count) {
-			pr_debug(1, "schema has padding of %zu bytes", length - offset);
-			break;
-		}
-		fprintf(o, "\t\t[%zu] = ", i);
-
-		print_schema_field_entry(field, o);
-
-		field++;
-		i ++;
+	switch (id) {
+	case CATALOG_SCHEMA:
+		PRINT_VIA_OUT(w->o, json_schema, m, &m->schemas[row]);
+		break;
+	case CATALOG_GROUP:
+		PRINT_VIA_OUT(w->o, json_group, m, &m->groups[row]);
+		break;
+	case CATALOG_EVENT:
+		PRINT_VIA_OUT(w->o, json_event, m, row);
+		break;
+	default:
+		break;
 	}
+}
 
-	if (i != field_entry_count)
-		warnx("schema ended before listed # of fields were parsed (got %zu, wanted %zu, offset %zu, length %zu)", i, field_entry_count, offset, length);
+static const struct walk_printer text_printer = {
+	.banner = print_walk_banner,
+	.record = print_walk_record,
+};
 
-	fprintf(o, "	}\n"
-		   "}\n");
-}
+static const struct walk_printer json_printer = {
+	.record = print_walk_json,
+};
 
 #define _pr_sz(l, s) pr_debug(l, #s " = %zu", s);
 #define pr_sz(l, s) _pr_sz(l, sizeof(s))
 #define pr_u(v) pr_debug(1, #v " = %u", v);
 
-static void _usage(const char *p, int e)
-{
-	FILE *o = stderr;
-	fprintf(o, "usage: %s <catalog file>\n", p);
-	exit(e);
-}
-
-#define _PRGM_NAME "parse"
-#define PRGM_NAME  (argc?argv[0]:_PRGM_NAME)
-#define usage(argc, argv, e) _usage(PRGM_NAME, e)
-#define U(e) usage(argc, argv, e)
-
-int main(int argc, char **argv)
+static void print_header(struct hv_24x7_catalog_page_0 *p0)
 {
-	err_set_progname(PRGM_NAME);
-	pr_sz(9, struct hv_24x7_catalog_page_0);
-
-	if (argc != 2)
-		U(0);
-
-	char *file = argv[1];
-
-	pr_debug(5, "filename = %s", file);
-	FILE *f = fopen(file, "rb");
-	if (!f)
-		err(1, "could not open %s", file);
-
-	char buf[4096];
-	ssize_t r = fread(buf, 1, sizeof(buf), f);
-	if (r != 4096)
-		err(1, "could not read page 0, got %zd bytes", r);
-
-	struct hv_24x7_catalog_page_0 *p0 = (void *)buf;
-
 	size_t catalog_page_length = be_to_cpu(p0->length);
 	pr_debug(1, "magic  = %.*s", (int)sizeof(p0->magic), (char *)&p0->magic);
 	pr_debug(1, "length = %zu pages", catalog_page_length);
@@ -526,215 +450,1195 @@ int main(int argc, char **argv)
 	pr_u(formula_data_offs);
 	pr_u(formula_data_len);
 	pr_u(formula_entry_count);
+}
 
-	/*
-	 * schema
-	 */
-	size_t schema_data_bytes = schema_data_len * 4096;
-	void *schema_data = malloc(schema_data_bytes);
-	if (!schema_data)
-		err(1, "alloc failure %zu", schema_data_bytes);
-	if (fseek(f, 4096 * schema_data_offs, SEEK_SET))
-		err(2, "seek failure");
-	if (fread(schema_data, 1, schema_data_bytes, f) != schema_data_bytes)
-		err(3, "read failure");
-
-	struct hv_24x7_grs *schema = schema_data;
-	void *end = schema_data + schema_data_bytes;
+struct parse_opts {
+	bool stream;
+	bool inventory;
+	const char *cache_dir;
+	unsigned sections;	/* from --sections, 0 if not given */
+	size_t window;		/* from --window, 0 if not given */
+	const char **event_names;	/* from --event */
+	size_t nr_event_names;
+	struct config_list configs;	/* from --resolve-config */
+	const char **patterns;		/* from --match */
+	size_t nr_patterns;
+	struct selector *selector;	/* the compiled patterns */
+	const char **queries;		/* from --search */
+	size_t nr_queries;
+	const char *emit_prefix;	/* from --emit-c */
+	bool compact;
+	bool mem_report;
+	unsigned jobs;			/* threads for checking one catalog's events */
+	bool salvage;
+	bool json;			/* --format=json */
+	const char *export_path;	/* from --export */
+};
+
+static void parse_opts_free(struct parse_opts *opts)
+{
+	free(opts->event_names);
+	free(opts->patterns);
+	free(opts->queries);
+	selector_free(opts->selector);
+	config_list_free(&opts->configs);
+}
+
+/* With --format=json, page 0 leads the records */
+static void print_catalog_json(const char *file, const struct hv_24x7_catalog_page_0 *p0,
+		const struct parse_opts *opts, FILE *o)
+{
+	if (opts->json)
+		PRINT_VIA_OUT(o, json_catalog, file, p0);
+}
+
+/*
+ * The sections whose records get printed: those asked for, or by default
+ * the events, plus the schemas and groups when debugging or printing JSON.
+ */
+static unsigned printed_sections(const struct parse_opts *opts)
+{
+	if (opts->emit_prefix || opts->export_path)
+		return 0;
+	if (opts->sections || opts->nr_event_names || opts->configs.nr
+			|| opts->nr_patterns || opts->nr_queries)
+		return opts->sections;
+	if (debug_is(1) || opts->json)
+		return CATALOG_SECTION_BIT(CATALOG_SCHEMA)
+			| CATALOG_SECTION_BIT(CATALOG_GROUP)
+			| CATALOG_SECTION_BIT(CATALOG_EVENT);
+	return CATALOG_SECTION_BIT(CATALOG_EVENT);
+}
+
+/* How the walkers print section @id, or NULL when it isn't printed */
+static const struct walk_printer *walk_printer(const struct parse_opts *opts,
+		unsigned printed, enum catalog_section_id id)
+{
+	if (!(printed & CATALOG_SECTION_BIT(id)))
+		return NULL;
+	return opts->json ? &json_printer : &text_printer;
+}
+
+/*
+ * The sections that have to be read and validated to print @printed.
+ * Events are always checked against the groups (see check_xrefs()), and
+ * the cache only holds complete models.
+ */
+static unsigned needed_sections(const struct parse_opts *opts, unsigned printed)
+{
+	unsigned need = printed;
+	if (opts->cache_dir || opts->export_path)
+		return CATALOG_ALL_SECTIONS;
+	if (opts->nr_event_names || opts->nr_patterns || opts->nr_queries || opts->emit_prefix
+			|| opts->compact || opts->configs.nr)
+		need |= CATALOG_SECTION_BIT(CATALOG_EVENT);
+	if (need & CATALOG_SECTION_BIT(CATALOG_EVENT))
+		need |= CATALOG_SECTION_BIT(CATALOG_GROUP);
+	return need;
+}
+
+static const char *const section_names[CATALOG_SECTION_COUNT] = {
+	[CATALOG_SCHEMA] = "schema",
+	[CATALOG_EVENT] = "event",
+	[CATALOG_GROUP] = "group",
+	[CATALOG_FORMULA] = "formula",
+};
+
+/* Parse a comma separated list of section names into a mask, 0 if invalid */
+static unsigned parse_sections(const char *list)
+{
+	unsigned mask = 0;
+	while (*list) {
+		size_t len = strcspn(list, ",");
+		unsigned id;
+		for (id = 0; id < CATALOG_SECTION_COUNT; id++)
+			if (strlen(section_names[id]) == len
+					&& !strncmp(list, section_names[id], len))
+				break;
+		if (id == CATALOG_SECTION_COUNT)
+			return 0;
+		mask |= CATALOG_SECTION_BIT(id);
+		list += len;
+		if (*list)
+			list++;
+	}
+	return mask;
+}
+
+/*
+ * Inventory: read nothing but page 0 and summarize it on a single line.
+ */
+static int inventory_one(const char *file, FILE *o, void *priv)
+{
+	char page0[CATALOG_PAGE_SIZE];
+	struct hv_24x7_catalog_page_0 *p0 = (void *)page0;
+	int fd = strcmp(file, "-") ? open(file, O_RDONLY) : STDIN_FILENO;
+	int r;
+
+	(void)priv;
+	if (fd < 0) {
+		warn("could not open %s", file);
+		return -1;
+	}
+
+	r = catalog_read_page0(fd, page0);
+	if (fd != STDIN_FILENO)
+		close(fd);
+	if (r) {
+		warn("could not read page 0 of %s", file);
+		return -1;
+	}
+
+	if (!catalog_page0_is_valid(p0)) {
+		warnx("%s: invalid catalog header", file);
+		return -1;
+	}
+
+	fprintf(o, "%s: length=%u version=%"PRIu64" build_time_stamp=%.*s"
+		" schemas=%u events=%u groups=%u formulas=%u\n",
+		file,
+		be_to_cpu(p0->length),
+		be_to_cpu(p0->version),
+		(int)strnlen((char *)p0->build_time_stamp, sizeof(p0->build_time_stamp)),
+		p0->build_time_stamp,
+		be_to_cpu(p0->schema_entry_count),
+		be_to_cpu(p0->event_entry_count),
+		be_to_cpu(p0->group_entry_count),
+		be_to_cpu(p0->formula_entry_count));
+	return 0;
+}
+
+/* Sum up what salvaging the @what section skipped, returning the records lost */
+static size_t report_salvage(const struct section_walk *w, const char *what)
+{
+	if (w->skipped_records)
+		warnx("salvage: skipped %zu damaged %s records (%zu bytes)",
+				w->skipped_records, what, w->skipped_bytes);
+	return w->skipped_records;
+}
+
+/* Warn about each of the @n bad references of @r, returning how many */
+static size_t report_xrefs(const struct xref_report *r, size_t n, const char *file)
+{
 	size_t i;
-	for (i = 0; ; i++) {
-		if (!schema_fixed_portion_is_within(schema, end)) {
-			warnx("schema fixed portion is not within range");
-			break;
-		}
 
-		size_t offset = (void *)schema - (void *)schema_data;
-		if (offset >= schema_data_bytes)
+	for (i = 0; i < min(n, (size_t)XREF_ERRORS_MAX); i++) {
+		const struct xref_error *x = &r->errors[i];
+		switch (x->kind) {
+		case XREF_GROUP_SCHEMA:
+			warnx("group %"PRIu32" uses schema %"PRIu32", which does not exist", x->from, x->to);
 			break;
-
-		if (i >= schema_entry_count) {
-			/* Padding follows the last schema, this is expected */
-			pr_debug(2, "schema count ends before buffer end (offset=%zu, bytes remaining=%zu)\n",
-					offset, schema_data_bytes - offset);
+		case XREF_GROUP_EVENT_COUNT:
+			warnx("group %"PRIu32" claims %"PRIu32" events, not 1 to 16", x->from, x->to);
 			break;
-		}
-
-		if (!schema_fixed_portion_is_within(schema, end)) {
-			warnx("schema fixed portion is not within range");
+		case XREF_GROUP_EVENT:
+			warnx("group %"PRIu32" lists event %"PRIu32", which does not exist", x->from, x->to);
+			break;
+		case XREF_GROUP_SKIPPED_EVENT:
+			warnx("group %"PRIu32" lists event %"PRIu32", which has no data", x->from, x->to);
+			break;
+		case XREF_EVENT_PRIMARY_GROUP:
+			warnx("event %"PRIu32" has primary group %"PRIu32", which does not exist", x->from, x->to);
 			break;
 		}
+	}
+	if (n > XREF_ERRORS_MAX)
+		warnx("%s: %zu more bad references", file, n - XREF_ERRORS_MAX);
+	return n;
+}
+
+/* Warn about each bad reference between the records of @m, returning how many */
+static size_t check_xrefs(const struct catalog_model *m, unsigned sections, const char *file)
+{
+	struct xref_report r;
+	return report_xrefs(&r, model_check_xrefs(m, sections, &r), file);
+}
 
-		size_t schema_len = be_to_cpu(schema->length);
-		if (debug_is(1))
-			printf("/* schema %zu of %u: len=%zu offset=%zu */\n", i, schema_entry_count, schema_len, offset);
+/* As check_xrefs(), for walks that dropped their records once @x noted them */
+static size_t check_seen_xrefs(struct xref_seen *x, const struct catalog_model *m,
+		unsigned sections, const char *file)
+{
+	struct xref_report r;
+	return report_xrefs(&r, xref_check(x, m, sections, &r), file);
+}
 
-		if (!IS_ALIGNED(schema_len, 16))
-			printf("/* missaligned */\n");
+/*
+ * Catalogs are decoded into a model kept by each thread and reset between
+ * them, so a batch worker's arena grows to fit the largest catalog it is
+ * given and then stops going back to the allocator.
+ */
+static __thread struct catalog_model thread_model;
+static pthread_key_t thread_model_key;
+static pthread_once_t thread_model_once = PTHREAD_ONCE_INIT;
 
-		void *schema_end = (__u8 *)schema + schema_len;
-		if (schema_end > end) {
-			warnx("schema ends after schema data: schema_end=%p > end=%p", schema_end, end);
-			break;
+static void thread_model_free(void *m)
+{
+	model_free(m);
+}
+
+static void thread_model_key_create(void)
+{
+	if (pthread_key_create(&thread_model_key, thread_model_free))
+		errx(1, "could not create a key for per thread models");
+}
+
+/* This thread's model, emptied for the catalog with page 0 @p0 */
+static struct catalog_model *get_model(const struct hv_24x7_catalog_page_0 *p0)
+{
+	pthread_once(&thread_model_once, thread_model_key_create);
+	/* so the model is freed when a batch worker exits */
+	pthread_setspecific(thread_model_key, &thread_model);
+	model_reset(&thread_model, p0);
+	return &thread_model;
+}
+
+/* Done with @m. This thread's own model is kept for the next catalog. */
+static void put_model(struct catalog_model *m)
+{
+	if (m != &thread_model)
+		model_free(m);
+}
+
+/* Returns 0, or -1 after reporting why @file could not be parsed */
+static int parse_stream(const char *file, const struct parse_opts *opts, FILE *o)
+{
+	int fd = strcmp(file, "-") ? open(file, O_RDONLY) : STDIN_FILENO;
+	if (fd < 0) {
+		warn("could not open %s", file);
+		return -1;
+	}
+
+	char page0[CATALOG_PAGE_SIZE];
+	if (catalog_read_page0(fd, page0)) {
+		warn("could not read page 0 of %s", file);
+		goto err_close;
+	}
+
+	struct hv_24x7_catalog_page_0 *p0 = (void *)page0;
+	print_header(p0);
+	print_catalog_json(file, p0, opts, o);
+
+	unsigned printed = printed_sections(opts);
+	unsigned need = needed_sections(opts, printed);
+	struct walk_stream s;
+	memset(&s, 0, sizeof(s));
+#define W(id, n) s.walk[id] = (struct section_walk) {			\
+		.bytes = (size_t)be_to_cpu(p0->n##_data_len) * CATALOG_PAGE_SIZE,	\
+		.count = be_to_cpu(p0->n##_entry_count), .keep = true,	\
+		.print = walk_printer(opts, printed, id), .o = o }
+	W(CATALOG_SCHEMA, schema);
+	W(CATALOG_EVENT, event);
+	W(CATALOG_GROUP, group);
+	W(CATALOG_FORMULA, formula);
+#undef W
+
+	/*
+	 * Only the decoded groups outlive their pages. If the group section
+	 * comes after the event section, events are printed without group
+	 * names.
+	 */
+	s.walk[CATALOG_EVENT].keep = false;
+	s.m = get_model(p0);
+
+	unsigned both = CATALOG_SECTION_BIT(CATALOG_GROUP) | CATALOG_SECTION_BIT(CATALOG_EVENT);
+	struct xref_seen seen;
+	bool check = (need & both) == both;
+	if (check) {
+		xref_seen_init(&seen, p0);
+		s.walk[CATALOG_SCHEMA].seen = s.walk[CATALOG_EVENT].seen = &seen;
+	}
+
+	int r = catalog_stream(fd, p0, need, walk_stream_page, &s);
+	if (r)
+		warn("could not stream %s", file);
+	else if ((need & CATALOG_SECTION_BIT(CATALOG_EVENT)) && !s.walk[CATALOG_EVENT].done
+			&& s.walk[CATALOG_EVENT].i != s.walk[CATALOG_EVENT].count)
+		/* as walk_events() would have, had the pages reached it */
+		warnx("event buffer ended before listed # of events were parsed (got %zu, wanted %u)",
+				s.walk[CATALOG_EVENT].i, s.walk[CATALOG_EVENT].count);
+	if (check) {
+		if (!r && check_seen_xrefs(&seen, s.m, need, file))
+			r = -1;
+		xref_seen_free(&seen);
+	}
+
+	unsigned id;
+	for (id = 0; id < CATALOG_SECTION_COUNT; id++)
+		catalog_window_free(&s.win[id]);
+	put_model(s.m);
+	if (fd != STDIN_FILENO)
+		close(fd);
+	return r;
+
+err_close:
+	if (fd != STDIN_FILENO)
+		close(fd);
+	return -1;
+}
+
+/*
+ * Bounded memory: each section is walked through a single window of
+ * opts->window bytes and no records are retained, except the groups when
+ * detailed events need their names.
+ */
+static int parse_windowed(const char *file, const struct parse_opts *opts, FILE *o)
+{
+	unsigned printed = printed_sections(opts);
+	unsigned need = needed_sections(opts, printed);
+	unsigned both = CATALOG_SECTION_BIT(CATALOG_GROUP) | CATALOG_SECTION_BIT(CATALOG_EVENT);
+	struct catalog_window win;
+	struct catalog_model *m;
+	struct xref_seen seen;
+	bool check = (need & both) == both;
+	int r = -1;
+
+	if (!strcmp(file, "-"))
+		file = "/dev/stdin";
+	int fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		warn("could not open %s", file);
+		return -1;
+	}
+
+	char page0[CATALOG_PAGE_SIZE];
+	if (catalog_read_page0(fd, page0)) {
+		warn("could not read page 0 of %s", file);
+		goto out_close;
+	}
+
+	struct hv_24x7_catalog_page_0 *p0 = (void *)page0;
+	print_header(p0);
+	print_catalog_json(file, p0, opts, o);
+
+	if (catalog_window_init(&win, opts->window)) {
+		warn("could not allocate a %zu byte window", opts->window);
+		goto out_close;
+	}
+	m = get_model(p0);
+
+	/* detailed events name their primary group */
+	bool keep_groups = (printed & CATALOG_SECTION_BIT(CATALOG_EVENT)) && debug_is(5)
+		&& !opts->json;
+	if (check)
+		xref_seen_init(&seen, p0);
+
+#define WALK(id, n) do {							\
+		struct section_walk w = {					\
+			.bytes = (size_t)be_to_cpu(p0->n##_data_len) * CATALOG_PAGE_SIZE, \
+			.count = be_to_cpu(p0->n##_entry_count),		\
+			.print = walk_printer(opts, printed, id),		\
+			.o = o,							\
+		};							\
+		w.keep = id == CATALOG_GROUP && (keep_groups || check);	\
+		if (check && id != CATALOG_GROUP)				\
+			w.seen = &seen;						\
+		if ((need & CATALOG_SECTION_BIT(id))				\
+				&& walk_windowed(fd, id, be_to_cpu(p0->n##_data_offs), &w, m, &win)) { \
+			warn("could not read the " #n " section of %s", file);	\
+			goto out_free;						\
+		}							\
+	} while (0)
+
+	WALK(CATALOG_SCHEMA, schema);
+	WALK(CATALOG_GROUP, group);
+	WALK(CATALOG_EVENT, event);
+#undef WALK
+	r = 0;
+
+out_free:
+	if (check) {
+		if (!r && check_seen_xrefs(&seen, m, need, file))
+			r = -1;
+		xref_seen_free(&seen);
+	}
+	put_model(m);
+	catalog_window_free(&win);
+out_close:
+	close(fd);
+	return r;
+}
+
+/*
+ * Print a model the same way the walkers would have while building it. There
+ * are no warnings to keep in step with, so it goes out a buffer at a time.
+ */
+static void print_model(const struct catalog_model *m, unsigned printed, bool json, FILE *o)
+{
+	struct out *ob = out_start(o);
+	size_t i;
+
+	for (i = 0; i < m->nr_schemas && (printed & CATALOG_SECTION_BIT(CATALOG_SCHEMA)); i++) {
+		const struct catalog_schema *s = &m->schemas[i];
+		if (json) {
+			json_schema(ob, m, s);
+			continue;
 		}
+		out_schema_banner(ob, s->index, be_to_cpu(m->p0.schema_entry_count), s->length, s->offset);
+		out_schema(ob, m, s);
+	}
 
-		if (!schema_is_within(schema, end)) {
-			warnx("schema exceeds schema data length schema=%p end=%p", schema, end);
-			break;
+	for (i = 0; i < m->nr_groups && (printed & CATALOG_SECTION_BIT(CATALOG_GROUP)); i++) {
+		const struct catalog_group *g = &m->groups[i];
+		if (json) {
+			json_group(ob, m, g);
+			continue;
 		}
+		out_group_banner(ob, g->index, be_to_cpu(m->p0.group_entry_count), g->length, g->offset);
+		out_group(ob, m, g);
+	}
 
-		if (!schema_is_within(schema, schema_end)) {
-			warnx("schema exceeds it's own length schema=%p end=%p", schema, schema_end);
-			break;
+	for (i = 0; i < m->nr_events && (printed & CATALOG_SECTION_BIT(CATALOG_EVENT)); i++) {
+		const struct catalog_events *e = &m->events;
+		if (e->skipped[i])
+			continue;
+		if (json) {
+			json_event(ob, m, i);
+			continue;
 		}
+		out_event_banner(ob, e->index[i], be_to_cpu(m->p0.event_entry_count), e->length[i], e->offset[i]);
+		out_event(ob, m, i);
+	}
 
-		if (debug_is(1))
-			print_schema(schema, stdout);
+	out_end(ob);
+}
 
-		schema = (void *)schema + schema_len;
+/*
+ * An event that was looked up, followed by the groups that hold it. As JSON,
+ * just the event: its record doesn't list them.
+ */
+static void print_found_event(const struct catalog_model *m, size_t ev, bool json, FILE *o)
+{
+	if (json) {
+		PRINT_VIA_OUT(o, json_event, m, ev);
+		return;
 	}
 
-	/*
-	 * groups
-	 */
-	struct hv_24x7_group_data **group_index = malloc(sizeof(*group_index) * group_entry_count);
-	if (!group_index)
-		err(1, "alloc failure group_index");
-
-	size_t group_data_bytes = group_data_len * 4096;
-	void *group_data = malloc(group_data_len);
-	if (!group_data)
-		err(1, "alloc failure %zu", group_data_bytes);
-	if (fseek(f, 4096 * group_data_offs, SEEK_SET))
-		err(2, "seek failure");
-	if (fread(group_data, 1, group_data_bytes, f) != group_data_bytes)
-		err(3, "read failure");
-
-	struct hv_24x7_group_data *group = group_data;
-	end = group_data + group_data_bytes;
-	for (i = 0; ; i++) {
-		if (!group_fixed_portion_is_within(group, end)) {
-			warnx("group fixed portion is not within range");
-			break;
+	struct out *ob = out_start(o);
+
+	out_event_banner(ob, m->events.index[ev], be_to_cpu(m->p0.event_entry_count),
+			m->events.length[ev], m->events.offset[ev]);
+	out_event(ob, m, ev);
+
+	const uint16_t *groups;
+	size_t j, nr_groups = model_event_groups(m, ev, &groups);
+	out_lit(ob, "/* groups:");
+	for (j = 0; j < nr_groups; j++) {
+		catalog_str_id gn = m->groups[groups[j]].name;
+		out_char(ob, ' ');
+		out_bytes(ob, model_str(m, gn), model_name_len(m, gn));
+	}
+	out_lit(ob, " */\n");
+	out_end(ob);
+}
+
+/* Print the events named by --event. Returns the number that don't exist. */
+static size_t print_named_events(const struct catalog_model *m,
+		const struct parse_opts *opts, FILE *o)
+{
+	size_t i, missing = 0;
+
+	for (i = 0; i < opts->nr_event_names; i++) {
+		const char *name = opts->event_names[i];
+		ssize_t ev = model_find_event(m, name, strlen(name));
+		if (ev < 0) {
+			warnx("no event named %s", name);
+			missing++;
+			continue;
 		}
+		print_found_event(m, ev, opts->json, o);
+	}
 
-		size_t offset = (void *)group - (void *)group_data;
-		if (offset >= group_data_bytes)
-			break;
+	return missing;
+}
 
-		if (i >= group_entry_count) {
-			/* Padding follows the last group, this is expected */
-			pr_debug(2, "group count ends before buffer end (offset=%zu, bytes remaining=%zu)\n",
-					offset, group_data_bytes - offset);
-			break;
+/*
+ * Print the events found by each --search query, best first. Returns the
+ * number of queries that found nothing.
+ */
+static size_t print_search_results(const struct catalog_model *m,
+		const struct parse_opts *opts, FILE *o)
+{
+	size_t i, missing = 0;
+
+	for (i = 0; i < opts->nr_queries; i++) {
+		struct text_hit *hits;
+		ssize_t j, nr = text_search(m, opts->queries[i], &hits);
+		if (nr < 0) {
+			warnx("unterminated quote in search '%s'", opts->queries[i]);
+			missing++;
+			continue;
+		}
+		if (!nr) {
+			warnx("nothing matches '%s'", opts->queries[i]);
+			missing++;
 		}
 
-		if (!group_fixed_portion_is_within(group, end)) {
-			warnx("group fixed portion is not within range");
-			break;
+		for (j = 0; j < nr; j++) {
+			catalog_str_id d = m->events.desc[hits[j].row];
+			const char *desc = model_str(m, d);
+			fprintf(o, "/* score %.2f: %.*s */\n", hits[j].score,
+					(int)model_name_len(m, d), desc);
+			print_found_event(m, hits[j].row, opts->json, o);
 		}
+		free(hits);
+	}
 
-		size_t group_len = be_to_cpu(group->length);
-		pr_debug(1, "/* group %zu of %u: len=%zu offset=%zu */\n", i, group_entry_count, group_len, offset);
+	return missing;
+}
 
-		if (!IS_ALIGNED(group_len, 16))
-			printf("/* missaligned */\n");
+/* Print the model as C tables for --emit-c. Returns 1 if it can't be. */
+static size_t print_c_tables(const struct catalog_model *m, const char *file,
+		const struct parse_opts *opts, FILE *o)
+{
+	if (!opts->emit_prefix)
+		return 0;
+	if (emit_c(m, opts->emit_prefix, o)) {
+		warnx("%s has no events, or no perfect hash of their names", file);
+		return 1;
+	}
+	return 0;
+}
 
-		void *group_end = (__u8 *)group + group_len;
-		if (group_end > end) {
-			warnx("group ends after group data: group_end=%p > end=%p", group_end, end);
-			break;
+/* Write the model out for --export. Returns 1 if it can't be. */
+static size_t export_model(const struct catalog_model *m, const char *file,
+		const struct parse_opts *opts)
+{
+	if (!opts->export_path)
+		return 0;
+	if (catalog_export(m, opts->export_path)) {
+		warn("could not export %s to %s", file, opts->export_path);
+		return 1;
+	}
+	return 0;
+}
+
+/* Print the events matching a --match pattern. Returns 1 if there are none. */
+static size_t print_matching_events(const struct catalog_model *m,
+		const struct parse_opts *opts, FILE *o)
+{
+	struct select_names names;
+	size_t i, found;
+
+	if (!opts->selector)
+		return 0;
+
+	uint32_t *rows = malloc(sizeof(*rows) * (m->nr_events + 1));
+	if (!rows)
+		err(1, "alloc failure");
+	select_names_build(&names, m);
+	found = selector_run(opts->selector, &names, m, rows);
+	for (i = 0; i < found; i++)
+		print_found_event(m, rows[i], opts->json, o);
+
+	select_names_free(&names);
+	free(rows);
+	if (!found)
+		warnx("no events match");
+	return !found;
+}
+
+/* The name of the event counting at @offset of catalog @domain, or NULL */
+typedef const char *(*counter_name_fn)(const void *db, unsigned domain, uint32_t offset);
+
+static const char *model_counter_name(const void *db, unsigned domain, uint32_t offset)
+{
+	const struct catalog_model *m = db;
+	ssize_t ev = model_find_counter(m, domain, offset);
+	return ev < 0 ? NULL : model_str(m, m->events.name[ev]);
+}
+
+static const char *compact_counter_name(const void *db, unsigned domain, uint32_t offset)
+{
+	const struct catalog_compact *cm = db;
+	ssize_t ev = compact_find_counter(cm, domain, offset);
+	return ev < 0 ? NULL : cm->names + cm->events[ev].name;
+}
+
+/* Name the event each --resolve-config counts. Returns the number unknown. */
+static size_t resolve_configs(const void *db, counter_name_fn name_of,
+		const struct parse_opts *opts, FILE *o)
+{
+	size_t i, unknown = 0;
+
+	for (i = 0; i < opts->configs.nr; i++) {
+		const struct hv_24x7_config *c = &opts->configs.configs[i];
+		int domain = config_catalog_domain(c->domain);
+		const char *name = domain < 0 ? NULL : name_of(db, domain, c->offset);
+
+		fprintf(o, "domain=0x%x,offset=0x%"PRIx32": ", c->domain, c->offset);
+		if (!name) {
+			fprintf(o, "UNKNOWN\n");
+			unknown++;
+			continue;
 		}
 
-		if (!group_is_within(group, end)) {
-			warnx("group exceeds group data length group=%p end=%p", group, end);
-			break;
+		fprintf(o, "%s\n", name);
+	}
+
+	return unknown;
+}
+
+/* Like print_named_events(), from the packed tables (which have no record positions) */
+static size_t print_compact_named_events(const struct catalog_compact *cm,
+		const struct parse_opts *opts, FILE *o)
+{
+	size_t i, j, missing = 0;
+
+	for (i = 0; i < opts->nr_event_names; i++) {
+		const char *name = opts->event_names[i];
+		ssize_t ev = compact_find_event(cm, name, strlen(name));
+		if (ev < 0) {
+			warnx("no event named %s", name);
+			missing++;
+			continue;
 		}
 
-		if (!group_is_within(group, group_end)) {
-			warnx("group exceeds it's own length group=%p end=%p", group, group_end);
-			break;
+		const struct compact_event *e = &cm->events[ev];
+		const struct compact_record *rec = &cm->records[ev];
+		struct out *ob = out_start(o);
+		out_event_banner(ob, rec->index, cm->catalog_events, rec->length, rec->offset);
+		print_event_for_all_domains(ob, cm->names + e->name, strlen(cm->names + e->name),
+				e->domain, e->offset);
+		out_lit(ob, "/* groups:");
+		for (j = 0; j < e->nr_groups; j++) {
+			out_char(ob, ' ');
+			out_str(ob, cm->names + cm->groups[cm->event_groups[e->first_group + j]].name);
 		}
+		out_lit(ob, " */\n");
+		out_end(ob);
+	}
+
+	return missing;
+}
 
-		group_index[i] = group;
-		if (debug_is(1))
-			print_group(group, stdout);
+struct mem_item {
+	const char *what;
+	size_t bytes;
+};
 
-		group = (void *)group + group_len;
+static void print_mem_report(const struct mem_item *items, size_t nr,
+		size_t nr_events, FILE *o)
+{
+	size_t i, total = 0;
+	double per = nr_events ? nr_events : 1;
+
+	fprintf(o, "/* resident bytes for %zu events:\n", nr_events);
+	for (i = 0; i < nr; i++) {
+		fprintf(o, " *   %-16s %9zu %8.1f per event\n", items[i].what,
+				items[i].bytes, items[i].bytes / per);
+		total += items[i].bytes;
 	}
+	fprintf(o, " *   %-16s %9zu %8.1f per event\n */\n", "total", total, total / per);
+}
 
-	/*
-	 * events
-	 */
-	size_t event_data_bytes = event_data_len * 4096;
-	void *event_data = malloc(event_data_bytes);
-	ssize_t rs;
-	if (!event_data)
-		err(1, "alloc failure %zu", event_data_bytes);
-	if (fseek(f, 4096 * event_data_offs, SEEK_SET))
-		err(2, "seek failure");
-	if ((rs = fread(event_data, 1, event_data_bytes, f)) != (ssize_t)event_data_bytes)
-		err(3, "read failure %zd", rs);
-
-	struct hv_24x7_event_data *event = event_data;
-	end = event_data + event_data_bytes;
-	for (i = 0; ; i++) {
-		size_t offset = (void *)event - (void *)event_data;
-		if (offset >= event_data_bytes)
-			break;
+#define MEM_ITEM(what_, bytes_) \
+	(items[n++] = (struct mem_item) { .what = (what_), .bytes = (bytes_) })
 
-		if (i >= event_entry_count) {
-			/* XXX: we have padding following the last event. Completely expected. */
-			pr_debug(2, "event count ends before buffer end (offset=%zu, end=%zu bytes remaining=%zu)\n",
-					offset, event_data_bytes, event_data_bytes - offset);
-			break;
-		}
+/*
+ * The model's tables, the arena they come from, and whatever of the
+ * catalog is still held.
+ */
+static void print_model_mem_report(const struct catalog_model *m,
+		const struct catalog *c, FILE *o)
+{
+	struct mem_item items[12];
+	size_t i, n = 0, in_arena = 0, row = 0, events = 0;
+
+#define C(type, name) row += sizeof(type);
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+	for (i = 0; i < m->nr_events; i++)
+		events += !m->events.skipped[i];
+
+	if (!m->map) {
+		MEM_ITEM("schemas", m->alloc_schemas * sizeof(*m->schemas)
+				+ m->alloc_fields * sizeof(*m->fields));
+		MEM_ITEM("groups", m->alloc_groups * sizeof(*m->groups));
+		MEM_ITEM("event columns", m->alloc_events * row);
+		MEM_ITEM("strings", m->alloc_strtab + m->alloc_strs * sizeof(*m->strs));
+		MEM_ITEM("name index", m->nr_name_disp * sizeof(*m->name_disp)
+				+ m->nr_name_slot * sizeof(*m->name_slot));
+		MEM_ITEM("text index", m->nr_terms * sizeof(*m->terms)
+				+ m->nr_postings * sizeof(*m->postings));
+	}
+	MEM_ITEM("string index", m->str_index_size * sizeof(*m->str_index));
+	MEM_ITEM("group index", !m->group_event_start ? 0 :
+			(m->nr_groups + 1) * sizeof(*m->group_event_start)
+			+ (m->nr_groups * 16 + 1) * sizeof(*m->group_event)
+			+ (m->nr_events + 1) * sizeof(*m->event_group_start)
+			+ (m->group_event_start[m->nr_groups] + 1) * sizeof(*m->event_group));
+	MEM_ITEM("counter index", m->counters ? (m->nr_events + 1) * sizeof(*m->counters) : 0);
+	for (i = 0; i < n; i++)
+		in_arena += items[i].bytes;
+	MEM_ITEM("unused arena", arena_size(&m->arena) > in_arena ?
+			arena_size(&m->arena) - in_arena : 0);
+	if (m->map)
+		MEM_ITEM("cache mapping", m->map_bytes);
+	MEM_ITEM("catalog pages", c->bytes);
+
+	print_mem_report(items, n, events, o);
+}
 
-		if (!event_fixed_portion_is_within(event, end)) {
-			warnx("event fixed portion is not within range");
-			break;
+static void print_compact_mem_report(const struct catalog_compact *cm, FILE *o)
+{
+	struct mem_item items[8];
+	size_t i, n = 0, used = 0;
+
+	MEM_ITEM("events", cm->nr_events * sizeof(*cm->events));
+	MEM_ITEM("records", cm->nr_events * sizeof(*cm->records));
+	MEM_ITEM("groups", cm->nr_groups * sizeof(*cm->groups));
+	MEM_ITEM("names", cm->names_len);
+	MEM_ITEM("memberships", (cm->nr_event_groups + cm->nr_group_events) * sizeof(uint16_t));
+	MEM_ITEM("name index", cm->nr_name_disp * sizeof(*cm->name_disp)
+			+ cm->nr_name_slot * sizeof(*cm->name_slot));
+	MEM_ITEM("counter index", cm->nr_events * sizeof(*cm->by_counter));
+	for (i = 0; i < n; i++)
+		used += items[i].bytes;
+	MEM_ITEM("arena padding", arena_size(&cm->arena) - used);
+
+	print_mem_report(items, n, cm->nr_events, o);
+}
+#undef MEM_ITEM
+
+/*
+ * Answer the lookups and reports asked for from @m, then let go of it (see
+ * put_model()) and free @c. With --compact, @m is packed and let go of
+ * before anything is looked up.
+ */
+static int finish_model(struct catalog_model *m, struct catalog *c, const char *file,
+		const struct parse_opts *opts, FILE *o)
+{
+	size_t missing;
+
+	if (opts->compact) {
+		struct catalog_compact cm;
+		int r = compact_build(&cm, m);
+		put_model(m);
+		catalog_close(c);
+		if (r) {
+			warnx("%s has no events, or too many to pack", file);
+			return -1;
 		}
 
-		size_t ev_len = be_to_cpu(event->length);
+		missing = print_compact_named_events(&cm, opts, o)
+			+ resolve_configs(&cm, compact_counter_name, opts, o);
+		if (opts->mem_report)
+			print_compact_mem_report(&cm, o);
+		compact_free(&cm);
+		return missing ? -1 : 0;
+	}
+
+	if (opts->configs.nr)
+		model_index_counters(m);
+	missing = print_named_events(m, opts, o)
+		+ print_matching_events(m, opts, o)
+		+ print_search_results(m, opts, o)
+		+ resolve_configs(m, model_counter_name, opts, o)
+		+ print_c_tables(m, file, opts, o)
+		+ export_model(m, file, opts);
+	if (opts->mem_report)
+		print_model_mem_report(m, c, o);
+
+	put_model(m);
+	catalog_close(c);
+	return missing ? -1 : 0;
+}
+
+static int parse_file(const char *file, const struct parse_opts *opts, FILE *o)
+{
+	const char *cache_dir = opts->cache_dir;
+	unsigned printed = printed_sections(opts);
+	unsigned need = needed_sections(opts, printed);
+	unsigned both = CATALOG_SECTION_BIT(CATALOG_GROUP) | CATALOG_SECTION_BIT(CATALOG_EVENT);
+	struct catalog c;
+	struct catalog_cache_key key;
+	if (!strcmp(file, "-"))
+		file = "/dev/stdin";
+	if (catalog_open(&c, file, need)) {
+		warn("could not load %s", file);
+		return -1;
+	}
 
-		if (event->event_group_record_len == 0) {
-			pr_debug(10, "invalid event, skipping\n");
-			goto next_event;
+	/* The cache doesn't keep the raw records that get hex dumped */
+	if (cache_dir && !debug_is(100)) {
+		struct catalog_model cached;
+		catalog_cache_key(&c, &key);
+		if (!catalog_cache_load(cache_dir, &key, &cached)) {
+			pr_debug(1, "using cached model");
+			print_header(&cached.p0);
+			print_catalog_json(file, &cached.p0, opts, o);
+			print_model(&cached, printed, opts->json, o);
+			model_index_groups(&cached);
+			size_t bad = (need & both) == both ? check_xrefs(&cached, need, file) : 0;
+			return finish_model(&cached, &c, file, opts, o) || bad ? -1 : 0;
 		}
-		printf("/* event %zu of %u: len=%zu offset=%zu */\n", i, event_entry_count, ev_len, offset);
+	}
+
+	print_header(c.p0);
+	print_catalog_json(file, c.p0, opts, o);
+
+	struct catalog_model *m = get_model(c.p0);
+	model_reserve(m, need);
+
+	size_t salvaged = 0;
+#define WALK(id, n, walker) do {						\
+		unsigned bit = CATALOG_SECTION_BIT(id);				\
+		struct section_walk w = SECTION_WALK_INIT(c.n, walk_printer(opts, printed, id), o); \
+		w.salvage = opts->salvage;					\
+		if (need & bit) {						\
+			walker(&w, m, c.n.data, c.n.bytes, true);		\
+			salvaged += report_salvage(&w, #n);			\
+		}								\
+	} while (0)
+
+	WALK(CATALOG_SCHEMA, schema, walk_schemas);
+	WALK(CATALOG_GROUP, group, walk_groups);
+#undef WALK
+
+	if (need & CATALOG_SECTION_BIT(CATALOG_EVENT)) {
+		struct section_walk w = SECTION_WALK_INIT(c.event,
+				walk_printer(opts, printed, CATALOG_EVENT), o);
+		struct event_check *checks = NULL;
+		if (opts->jobs > 1)
+			checks = events_check(c.event.data, c.event.bytes, c.event.entry_count,
+					opts->jobs, &w.nr_checks);
+		w.checks = checks;
+		w.salvage = opts->salvage;
+		walk_events(&w, m, c.event.data, c.event.bytes, true);
+		salvaged += report_salvage(&w, "event");
+		free(checks);
+	}
+
+	/* TODO: for each formula */
+
+	if (opts->nr_event_names || opts->emit_prefix || opts->compact || cache_dir)
+		model_index_event_names(m);
+	size_t bad = 0;
+	if ((need & both) == both) {
+		model_index_groups(m);
+		bad = check_xrefs(m, need, file);
+	}
+	if (opts->nr_queries || cache_dir)
+		text_index_build(m);
+
+	if (cache_dir && !debug_is(100) && catalog_cache_store(cache_dir, &key, m))
+		warn("could not write cache to %s", cache_dir);
+
+	return finish_model(m, &c, file, opts, o) || bad || salvaged ? -1 : 0;
+}
+
+static int parse_one(const char *file, FILE *o, void *priv)
+{
+	const struct parse_opts *opts = priv;
+
+	pr_debug(5, "filename = %s", file);
+	if (opts->inventory)
+		return inventory_one(file, o, priv);
+	if (opts->stream)
+		return parse_stream(file, opts, o);
+	if (opts->window)
+		return parse_windowed(file, opts, o);
+	return parse_file(file, opts, o);
+}
+
+/*
+ * In batch mode each catalog's output is preceded by its name (inventory
+ * records and JSON catalog lines already carry it).
+ */
+static int parse_one_batched(const char *file, FILE *o, void *priv)
+{
+	const struct parse_opts *opts = priv;
+	if (!opts->inventory && !opts->json)
+		fprintf(o, "/* catalog %s */\n", file);
+	return parse_one(file, o, priv);
+}
+
+static void _usage(const char *p, int e)
+{
+	FILE *o = stderr;
+	fprintf(o, "usage: %s [options] <catalog file|directory>...\n"
+		"options:\n"
+		"  -s, --stream    parse pages in order as they are read, allowing\n"
+		"                  pipes and other non-seekable input ('-' is stdin)\n"
+		"  -c, --cache DIR keep decoded catalogs in DIR and reuse them on\n"
+		"                  later runs (not used with --stream or --window)\n"
+		"  -T, --files-from LIST\n"
+		"                  also parse the catalogs named (one per line) in LIST\n"
+		"  -j, --jobs N    parse up to N catalogs at once (default: one per cpu);\n"
+		"                  a single catalog has its events checked by up to\n"
+		"                  N threads\n"
+		"  -i, --inventory only read page 0, and print a one line summary of\n"
+		"                  each catalog\n"
+		"  -S, --sections LIST\n"
+		"                  print only the records of the comma separated\n"
+		"                  sections in LIST (schema, group, event); the\n"
+		"                  pages of other sections are not read\n"
+		"  -e, --event NAME\n"
+		"                  print just the event called NAME (may be repeated)\n"
+		"  -m, --match PATTERN\n"
+		"                  print the events whose names match PATTERN (may\n"
+		"                  be repeated): a glob, or with a leading '^', a\n"
+		"                  regex of literals, '.', [...], with *, + or ?,\n"
+		"                  anchored at the end only by a final '$'\n"
+		"  -q, --search QUERY\n"
+		"                  search the event descriptions, printing the events\n"
+		"                  best matching QUERY's words first; \"quoted\n"
+		"                  phrases\" must appear as written (may be repeated)\n"
+		"  -C, --emit-c[=PREFIX]\n"
+		"                  instead of the usual output, print a C header\n"
+		"                  holding the events and groups as static const\n"
+		"                  tables, with a perfect hash lookup of event names;\n"
+		"                  its identifiers start with PREFIX (default\n"
+		"                  " EMIT_C_DEFAULT_PREFIX ")\n"
+		"  -X, --export FILE\n"
+		"                  instead of the usual output, write the decoded\n"
+		"                  catalog to FILE in a little endian, versioned\n"
+		"                  binary form (see export.h) other tools can map\n"
+		"                  and read in place; a single catalog only\n"
+		"  -k, --compact   keep only what collection needs (names, domains,\n"
+		"                  counter offsets and groups) in packed tables,\n"
+		"                  dropping the rest of the catalog before --event\n"
+		"                  and --resolve-config lookups are made\n"
+		"  -M, --mem-report\n"
+		"                  after parsing, print the bytes held by each part\n"
+		"                  of the decoded catalog\n"
+		"  -x, --salvage   step over damaged records, picking the walk up at\n"
+		"                  the next record that looks whole, rather than\n"
+		"                  giving up on the rest of the section; the byte\n"
+		"                  ranges skipped are reported (not used with\n"
+		"                  --stream, --window or --cache)\n"
+		"  -f, --format FMT\n"
+		"                  print records as text (the default), or as json:\n"
+		"                  page 0 and then each record (schemas and groups\n"
+		"                  included) as a JSON object on a line of its own,\n"
+		"                  written as the record is checked; not used with\n"
+		"                  --inventory, --search, --resolve-config, --emit-c,\n"
+		"                  --compact or --mem-report\n"
+		"  -r, --resolve-config FILE\n"
+		"                  name the event behind each hv_24x7 config listed\n"
+		"                  in FILE ('-' is stdin), one per line: either\n"
+		"                  domain=..,offset=.. terms or a raw config value\n"
+		"                  (as `perf evlist [-v]` prints them)\n"
+		"  -W, --window SIZE\n"
+		"                  read each section through a window of SIZE bytes\n"
+		"                  (k and M suffixes allowed, at least 72k), keeping\n"
+		"                  memory use independent of the catalog's size\n"
+		"\n"
+		"--event, --match, --search, --resolve-config, --emit-c and --export\n"
+		"are not used with --stream or --window, and --compact only with\n"
+		"--event and --resolve-config.\n"
+		"\n"
+		"Given more than one catalog, or a directory (whose entries are parsed\n"
+		"in name order), output for each catalog is preceded by its name and\n"
+		"emitted in the order the catalogs were given.\n", p);
+	exit(e);
+}
+
+#define _PRGM_NAME "parse"
+#define PRGM_NAME  (argc?argv[0]:_PRGM_NAME)
+#define usage(argc, argv, e) _usage(PRGM_NAME, e)
+#define U(e) usage(argc, argv, e)
+
+static const struct option longopts[] = {
+	{ "stream", no_argument, NULL, 's' },
+	{ "cache", required_argument, NULL, 'c' },
+	{ "files-from", required_argument, NULL, 'T' },
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "inventory", no_argument, NULL, 'i' },
+	{ "sections", required_argument, NULL, 'S' },
+	{ "window", required_argument, NULL, 'W' },
+	{ "event", required_argument, NULL, 'e' },
+	{ "resolve-config", required_argument, NULL, 'r' },
+	{ "match", required_argument, NULL, 'm' },
+	{ "search", required_argument, NULL, 'q' },
+	{ "emit-c", optional_argument, NULL, 'C' },
+	{ "export", required_argument, NULL, 'X' },
+	{ "compact", no_argument, NULL, 'k' },
+	{ "mem-report", no_argument, NULL, 'M' },
+	{ "salvage", no_argument, NULL, 'x' },
+	{ "format", required_argument, NULL, 'f' },
+	{ "help", no_argument, NULL, 'h' },
+	{ }
+};
 
-		if (!IS_ALIGNED(ev_len, 16))
-			printf("/* missaligned */\n");
+int main(int argc, char **argv)
+{
+	struct parse_opts opts = { };
+	struct batch_list list = { };
+	bool batch = false;
+	unsigned jobs = 0;
+	int opt;
+
+	err_set_progname(PRGM_NAME);
+	pr_sz(9, struct hv_24x7_catalog_page_0);
 
-		void *ev_end = (__u8 *)event + ev_len;
-		if (ev_end > end) {
-			warnx("event ends after event data: ev_end=%p > end=%p", ev_end, end);
+	while ((opt = getopt_long(argc, argv, "sc:T:j:iS:W:e:r:m:q:C::X:kMxf:h", longopts, NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			opts.stream = true;
+			break;
+		case 'c':
+			opts.cache_dir = optarg;
+			break;
+		case 'i':
+			opts.inventory = true;
+			break;
+		case 'W': {
+			char *end;
+			unsigned long long v = strtoull(optarg, &end, 0);
+			if (*end == 'k' || *end == 'K')
+				v <<= 10, end++;
+			else if (*end == 'm' || *end == 'M')
+				v <<= 20, end++;
+			if (*end || v < CATALOG_WINDOW_MIN || v > SIZE_MAX)
+				errx(1, "bad window size '%s' (must be at least %zu bytes)",
+						optarg, (size_t)CATALOG_WINDOW_MIN);
+			opts.window = v;
 			break;
 		}
-
-		if (!event_is_within(event, end)) {
-			warnx("event exceeds event data length event=%p end=%p", event, end);
+		case 'e': {
+			const char **n = realloc(opts.event_names,
+					sizeof(*n) * (opts.nr_event_names + 1));
+			if (!n)
+				err(1, "alloc failure");
+			n[opts.nr_event_names++] = optarg;
+			opts.event_names = n;
 			break;
 		}
-
-		if (!event_is_within(event, ev_end)) {
-			warnx("event exceeds it's own length event=%p end=%p", event, ev_end);
+		case 'm': {
+			const char **p = realloc(opts.patterns,
+					sizeof(*p) * (opts.nr_patterns + 1));
+			if (!p)
+				err(1, "alloc failure");
+			p[opts.nr_patterns++] = optarg;
+			opts.patterns = p;
 			break;
 		}
-
-		if (!event_is_within(event, PTR_ALIGN(event, 4096))) {
-			warnx("event crosses page boundary");
+		case 'q': {
+			const char **q = realloc(opts.queries,
+					sizeof(*q) * (opts.nr_queries + 1));
+			if (!q)
+				err(1, "alloc failure");
+			q[opts.nr_queries++] = optarg;
+			opts.queries = q;
+			break;
 		}
+		case 'C':
+			opts.emit_prefix = optarg ? optarg : EMIT_C_DEFAULT_PREFIX;
+			if (!emit_c_prefix_is_valid(opts.emit_prefix))
+				errx(1, "'%s' can't start a C identifier", opts.emit_prefix);
+			break;
+		case 'X':
+			opts.export_path = optarg;
+			break;
+		case 'k':
+			opts.compact = true;
+			break;
+		case 'M':
+			opts.mem_report = true;
+			break;
+		case 'x':
+			opts.salvage = true;
+			break;
+		case 'f':
+			if (!strcmp(optarg, "json"))
+				opts.json = true;
+			else if (strcmp(optarg, "text"))
+				errx(1, "unknown format '%s' (text or json)", optarg);
+			break;
+		case 'r':
+			if (config_list_add_from(&opts.configs, optarg))
+				err(1, "could not read configs from %s", optarg);
+			break;
+		case 'S':
+			opts.sections = parse_sections(optarg);
+			if (!opts.sections)
+				errx(1, "bad section list '%s'", optarg);
+			break;
+		case 'T':
+			if (batch_list_add_from(&list, optarg))
+				err(1, "could not read list %s", optarg);
+			batch = true;
+			break;
+		case 'j': {
+			char *end;
+			unsigned long v = strtoul(optarg, &end, 0);
+			if (*end || !v || v > UINT_MAX)
+				errx(1, "bad job count '%s'", optarg);
+			jobs = v;
+			break;
+		}
+		case 'h':
+			U(0);
+		default:
+			U(1);
+		}
+	}
 
-		print_event(event, group_index, group_entry_count, stdout);
+	if ((opts.nr_event_names || opts.nr_patterns || opts.nr_queries || opts.configs.nr
+				|| opts.emit_prefix || opts.export_path)
+			&& (opts.stream || opts.window))
+		errx(1, "--event, --match, --search, --resolve-config, --emit-c and --export can't be combined with --stream or --window");
+	if (opts.compact && (opts.stream || opts.window || opts.nr_patterns || opts.nr_queries
+				|| opts.emit_prefix || opts.export_path))
+		errx(1, "--compact can only be combined with --event and --resolve-config");
+	if (opts.mem_report && (opts.stream || opts.window || opts.inventory))
+		errx(1, "--mem-report can't be combined with --stream, --window or --inventory");
+	if (opts.salvage && (opts.stream || opts.window || opts.cache_dir))
+		errx(1, "--salvage can't be combined with --stream, --window or --cache");
+	if (opts.json && (opts.inventory || opts.nr_queries || opts.configs.nr || opts.emit_prefix
+				|| opts.compact || opts.mem_report))
+		errx(1, "--format=json can't be combined with --inventory, --search, --resolve-config, --emit-c, --compact or --mem-report");
+	if (opts.export_path && (opts.inventory || opts.json || opts.emit_prefix))
+		errx(1, "--export can't be combined with --inventory, --format=json or --emit-c");
 
-next_event:
-		event = (void *)event + ev_len;
+	/*
+	 * Records are handed to stdout whole (see out.h), so unless someone is
+	 * watching let them gather into large writes.
+	 */
+	static char stdout_buf[1024 * 1024];
+	if (!isatty(STDOUT_FILENO))
+		setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+
+	if (opts.nr_patterns) {
+		opts.selector = selector_compile(opts.patterns, opts.nr_patterns);
+		if (!opts.selector)
+			errx(1, "bad pattern");
 	}
 
-	if (i != event_entry_count)
-		warnx("event buffer ended before listed # of events were parsed (got %zu, wanted %u)", i, event_entry_count);
+	if (!jobs) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = n > 0 ? n : 1;
+	}
 
-	/* TODO: for each formula */
+	if (argc - optind == 1 && !batch) {
+		struct stat st;
+		char *file = argv[optind];
+		if (strcmp(file, "-") && !stat(file, &st) && S_ISDIR(st.st_mode)) {
+			batch = true;
+		} else {
+			/* a lone catalog gets the threads to itself */
+			opts.jobs = jobs;
+			int r = parse_one(file, stdout, &opts);
+			parse_opts_free(&opts);
+			return r ? 1 : 0;
+		}
+	}
 
-	return 0;
+	if (argc - optind < 1 && !batch)
+		U(0);
+
+	/* each catalog would replace the last */
+	if (opts.export_path)
+		errx(1, "--export takes a single catalog");
+
+	int i;
+	for (i = optind; i < argc; i++)
+		if (batch_list_add(&list, argv[i]))
+			err(1, "could not add %s", argv[i]);
+
+	size_t failed = batch_run(&list, jobs, parse_one_batched, &opts, stdout);
+	batch_list_free(&list);
+	parse_opts_free(&opts);
+	return failed ? 1 : 0;
 }
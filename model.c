@@ -0,0 +1,760 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <ccan/pr_debug/pr_debug.h>
+#include <ccan/err/err.h>
+#include <ccan/endian/endian.h>
+#include <ccan/array_size/array_size.h>
+#include <ccan/hash/hash.h>
+
+#include <penny/math.h>
+
+#include "catalog.h"
+#include "model.h"
+
+/* The length fields after names and descriptions need not be aligned */
+static unsigned be16_at(const void *p)
+{
+	__be16 v;
+	memcpy(&v, p, sizeof(v));
+	return be_to_cpu(v);
+}
+
+static char *event_name(struct hv_24x7_event_data *ev, size_t *len)
+{
+	*len = be_to_cpu(ev->event_name_len) - 2;
+	return (char *)ev->remainder;
+}
+
+static char *event_desc(struct hv_24x7_event_data *ev, size_t *len)
+{
+	unsigned nl = be_to_cpu(ev->event_name_len);
+	*len = be16_at(ev->remainder + nl - 2) - 2;
+	return (char *)ev->remainder + nl;
+}
+
+static char *event_long_desc(struct hv_24x7_event_data *ev, size_t *len)
+{
+	unsigned nl = be_to_cpu(ev->event_name_len);
+	unsigned desc_len = be16_at(ev->remainder + nl - 2);
+	*len = be16_at(ev->remainder + nl + desc_len - 2) - 2;
+	return (char *)ev->remainder + nl + desc_len;
+}
+
+static char *group_name(struct hv_24x7_group_data *group, size_t *len)
+{
+	*len = be_to_cpu(group->group_name_len) - 2;
+	return (char *)group->remainder;
+}
+
+static char *group_desc(struct hv_24x7_group_data *group, size_t *len)
+{
+	unsigned nl = be_to_cpu(group->group_name_len);
+	*len = be16_at(group->remainder + nl - 2) - 2;
+	return (char *)group->remainder + nl;
+}
+
+/* Grow *@p (of *@alloc elements of @sz bytes) to hold at least @want */
+static void grow(struct arena *a, void **p, size_t *alloc, size_t want, size_t sz)
+{
+	if (want <= *alloc)
+		return;
+
+	size_t n = *alloc ? *alloc : max(want, (size_t)16);
+	while (n < want)
+		n *= 2;
+
+	*p = arena_realloc(a, *p, *alloc * sz, n * sz);
+	*alloc = n;
+}
+
+#define GROW(m, name, want) \
+	grow(&(m)->arena, (void **)&(m)->name, &(m)->alloc_##name, (want), sizeof(*(m)->name))
+
+/* Every column starts out with alloc_events elements, and grows alike */
+static void grow_events(struct catalog_model *m, size_t want)
+{
+	size_t alloc;
+#define C(type, name) \
+	alloc = m->alloc_events; \
+	grow(&m->arena, (void **)&m->events.name, &alloc, want, sizeof(type));
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+	m->alloc_events = alloc;
+}
+
+static uint32_t str_hash(const char *s, size_t len)
+{
+	return hash64_stable((const uint8_t *)s, len, 0);
+}
+
+/* The str_index slot holding @s, or the empty one where it would go */
+static size_t str_index_find(const struct catalog_model *m, const char *s, size_t len)
+{
+	size_t mask = m->str_index_size - 1;
+	size_t i = str_hash(s, len) & mask;
+
+	for (;; i = (i + 1) & mask) {
+		uint32_t v = m->str_index[i];
+		if (!v)
+			return i;
+		const struct catalog_str *e = &m->strs[v - 1];
+		if (e->len == len && !memcmp(m->strtab + e->offs, s, len))
+			return i;
+	}
+}
+
+static void str_index_resize(struct catalog_model *m, size_t size)
+{
+	uint32_t *old = m->str_index;
+	size_t i, old_size = m->str_index_size;
+
+	m->str_index = arena_zalloc(&m->arena, size * sizeof(*m->str_index));
+	m->str_index_size = size;
+
+	for (i = 0; i < old_size; i++) {
+		if (!old[i])
+			continue;
+		const struct catalog_str *e = &m->strs[old[i] - 1];
+		m->str_index[str_index_find(m, m->strtab + e->offs, e->len)] = old[i];
+	}
+}
+
+static catalog_str_id add_str(struct catalog_model *m, const char *s, size_t len)
+{
+	/* Keep the index at most half full */
+	if ((m->nr_strs + 1) * 2 > m->str_index_size)
+		str_index_resize(m, m->str_index_size ? m->str_index_size * 2 : 1024);
+
+	size_t slot = str_index_find(m, s, len);
+	if (m->str_index[slot])
+		return m->str_index[slot] - 1;
+
+	GROW(m, strs, m->nr_strs + 1);
+	m->strs[m->nr_strs] = (struct catalog_str) { m->strtab_len, len };
+
+	/* keep strings nul terminated for the convenience of users */
+	GROW(m, strtab, m->strtab_len + len + 1);
+	memcpy(m->strtab + m->strtab_len, s, len);
+	m->strtab[m->strtab_len + len] = '\0';
+	m->strtab_len += len + 1;
+
+	m->str_index[slot] = ++m->nr_strs;
+	return m->nr_strs - 1;
+}
+
+catalog_str_id model_intern(struct catalog_model *m, const char *s, size_t len)
+{
+	return add_str(m, s, len);
+}
+
+/*
+ * Forget the strings interned since str_mark. They are the most recently
+ * added, so each can be taken out of the index by backward shift deletion
+ * without disturbing any other string's probe sequence.
+ */
+static void drop_strs(struct catalog_model *m)
+{
+	size_t mask = m->str_index_size - 1;
+
+	while (m->nr_strs > m->str_mark) {
+		const struct catalog_str *e = &m->strs[m->nr_strs - 1];
+		size_t i = str_index_find(m, m->strtab + e->offs, e->len), j = i;
+
+		for (;;) {
+			j = (j + 1) & mask;
+			uint32_t v = m->str_index[j];
+			if (!v)
+				break;
+			const struct catalog_str *f = &m->strs[v - 1];
+			size_t home = str_hash(m->strtab + f->offs, f->len) & mask;
+			/* move it back if its home isn't cyclically within (i, j] */
+			if (((j - home) & mask) >= ((j - i) & mask)) {
+				m->str_index[i] = v;
+				i = j;
+			}
+		}
+		m->str_index[i] = 0;
+
+		m->strtab_len = e->offs;
+		m->nr_strs--;
+	}
+}
+
+void model_init(struct catalog_model *m, const struct hv_24x7_catalog_page_0 *p0)
+{
+	memset(m, 0, sizeof(*m));
+	arena_init(&m->arena);
+	m->p0 = *p0;
+}
+
+void model_reset(struct catalog_model *m, const struct hv_24x7_catalog_page_0 *p0)
+{
+	struct arena a = m->arena;
+
+	if (m->map)
+		munmap(m->map, m->map_bytes);
+	arena_reset(&a);
+	memset(m, 0, sizeof(*m));
+	m->arena = a;
+	m->p0 = *p0;
+}
+
+void model_free(struct catalog_model *m)
+{
+	if (m->map)
+		munmap(m->map, m->map_bytes);
+	arena_free(&m->arena);
+	memset(m, 0, sizeof(*m));
+}
+
+/* What decoding the records of the sections could take, by page 0 */
+void model_reserve(struct catalog_model *m, unsigned sections)
+{
+	const struct hv_24x7_catalog_page_0 *p0 = &m->p0;
+	size_t schemas = 0, fields = 0, groups = 0, events = 0, text = 0;
+	size_t row = 0, columns = 0, bytes;
+
+	if (sections & CATALOG_SECTION_BIT(CATALOG_SCHEMA)) {
+		schemas = be_to_cpu(p0->schema_entry_count);
+		fields = (size_t)be_to_cpu(p0->schema_data_len) * CATALOG_PAGE_SIZE
+			/ sizeof(struct hv_24x7_grs_field);
+	}
+	if (sections & CATALOG_SECTION_BIT(CATALOG_GROUP)) {
+		groups = be_to_cpu(p0->group_entry_count);
+		text += (size_t)be_to_cpu(p0->group_data_len) * CATALOG_PAGE_SIZE;
+	}
+	if (sections & CATALOG_SECTION_BIT(CATALOG_EVENT)) {
+		events = be_to_cpu(p0->event_entry_count);
+		text += (size_t)be_to_cpu(p0->event_data_len) * CATALOG_PAGE_SIZE;
+	}
+#define C(type, name) row += sizeof(type); columns++;
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+
+	/*
+	 * Strings are never longer than the records holding them. The rest
+	 * (string, name, group and counter indexes) is a guess; the arena
+	 * grows past it if need be.
+	 */
+	size_t strs = 3 * events + 2 * groups;
+	size_t index = 1024;
+	while (index < 2 * strs)
+		index *= 2;
+	bytes = schemas * sizeof(*m->schemas) + fields * sizeof(*m->fields)
+		+ groups * sizeof(*m->groups) + events * row
+		+ text + strs * sizeof(*m->strs) + index * sizeof(*m->str_index)
+		+ groups * 16 * 2 * sizeof(uint16_t) + events * 64
+		+ (columns + 8) * ARENA_ALIGN;
+	arena_reserve(&m->arena, bytes);
+
+	GROW(m, schemas, schemas);
+	GROW(m, fields, fields);
+	GROW(m, groups, groups);
+	grow_events(m, events);
+	GROW(m, strtab, text);
+	GROW(m, strs, strs);
+	if (index > m->str_index_size)
+		str_index_resize(m, index);
+	pr_debug(2, "reserved %zu bytes for the model", bytes);
+}
+
+struct catalog_schema *model_add_schema(struct catalog_model *m,
+		struct hv_24x7_grs *schema, size_t index, size_t offset)
+{
+	GROW(m, schemas, m->nr_schemas + 1);
+	struct catalog_schema *s = &m->schemas[m->nr_schemas++];
+
+	*s = (struct catalog_schema) {
+		.index = index,
+		.offset = offset,
+		.length = be_to_cpu(schema->length),
+		.descriptor = be_to_cpu(schema->descriptor),
+		.version_id = be_to_cpu(schema->version_id),
+		.field_entry_count = be_to_cpu(schema->field_entry_count),
+		.first_field = m->nr_fields,
+	};
+
+	struct hv_24x7_grs_field *field = (void *)schema->field_entrys;
+	for (;;) {
+		size_t field_offset = (void *)field - (void *)schema;
+		if (field_offset + sizeof(*field) > s->length)
+			break;
+
+		if (s->nr_fields >= s->field_entry_count) {
+			pr_debug(1, "schema has padding of %zu bytes", s->length - field_offset);
+			break;
+		}
+
+		GROW(m, fields, m->nr_fields + 1);
+		m->fields[m->nr_fields++] = (struct catalog_schema_field) {
+			.field_enum = be_to_cpu(field->field_enum),
+			.offs = be_to_cpu(field->offs),
+			.length = be_to_cpu(field->length),
+			.flags = be_to_cpu(field->flags),
+		};
+
+		field++;
+		s->nr_fields++;
+	}
+
+	return s;
+}
+
+struct catalog_group *model_add_group(struct catalog_model *m,
+		struct hv_24x7_group_data *group, size_t index, size_t offset)
+{
+	size_t i, name_len, desc_len;
+	char *name = group_name(group, &name_len);
+	char *desc = group_desc(group, &desc_len);
+
+	GROW(m, groups, m->nr_groups + 1);
+	struct catalog_group *g = &m->groups[m->nr_groups++];
+
+	*g = (struct catalog_group) {
+		.index = index,
+		.offset = offset,
+		.flags = be_to_cpu(group->flags),
+		.length = be_to_cpu(group->length),
+		.domain = group->domain,
+		.schema_ix = group->group_schema_ix,
+		.group_record_offs = be_to_cpu(group->event_group_record_offs),
+		.group_record_len = be_to_cpu(group->event_group_record_len),
+		.event_count = group->event_count,
+	};
+
+	for (i = 0; i < ARRAY_SIZE(g->event_ixs); i++)
+		g->event_ixs[i] = be_to_cpu(group->event_ixs[i]);
+
+	m->str_mark = m->nr_strs;
+	g->name = add_str(m, name, name_len);
+	g->desc = add_str(m, desc, desc_len);
+	return g;
+}
+
+size_t model_add_event(struct catalog_model *m,
+		struct hv_24x7_event_data *event, size_t index, size_t offset)
+{
+	struct catalog_events *e = &m->events;
+	size_t i = m->nr_events;
+
+	grow_events(m, i + 1);
+	m->nr_events++;
+
+	e->index[i] = index;
+	e->offset[i] = offset;
+	e->length[i] = be_to_cpu(event->length);
+	e->domain[i] = event->domain;
+	e->group_record_offs[i] = be_to_cpu(event->event_group_record_offs);
+	e->group_record_len[i] = be_to_cpu(event->event_group_record_len);
+	e->counter_offs[i] = be_to_cpu(event->event_counter_offs);
+	e->flags[i] = be_to_cpu(event->flags);
+	e->primary_group_ix[i] = be_to_cpu(event->primary_group_ix);
+	e->group_count[i] = be_to_cpu(event->group_count);
+
+	/* the remainder of a skipped event was never validated */
+	m->str_mark = m->nr_strs;
+	e->skipped[i] = !e->group_record_len[i];
+	if (e->skipped[i]) {
+		e->name[i] = e->desc[i] = e->long_desc[i] = add_str(m, "", 0);
+		return i;
+	}
+
+	size_t name_len, desc_len, long_desc_len;
+	const char *name = event_name(event, &name_len);
+	const char *desc = event_desc(event, &desc_len);
+	const char *long_desc = event_long_desc(event, &long_desc_len);
+
+	e->name[i] = add_str(m, name, name_len);
+	e->desc[i] = add_str(m, desc, desc_len);
+	e->long_desc[i] = add_str(m, long_desc, long_desc_len);
+	return i;
+}
+
+size_t model_add_damaged_event(struct catalog_model *m,
+		size_t index, size_t offset, size_t length)
+{
+	struct catalog_events *e = &m->events;
+	size_t i = m->nr_events;
+
+	grow_events(m, i + 1);
+	m->nr_events++;
+
+#define C(type, name) e->name[i] = 0;
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+	e->index[i] = index;
+	e->offset[i] = offset;
+	e->length[i] = length;
+	e->skipped[i] = true;
+
+	m->str_mark = m->nr_strs;
+	e->name[i] = e->desc[i] = e->long_desc[i] = add_str(m, "", 0);
+	return i;
+}
+
+void model_drop_last_schema(struct catalog_model *m)
+{
+	struct catalog_schema *s = &m->schemas[--m->nr_schemas];
+	m->nr_fields = s->first_field;
+}
+
+void model_drop_last_group(struct catalog_model *m)
+{
+	m->nr_groups--;
+	drop_strs(m);
+}
+
+void model_drop_last_event(struct catalog_model *m)
+{
+	m->nr_events--;
+	drop_strs(m);
+}
+
+#define NAMES_PER_BUCKET 4
+/*
+ * Displacements tried for each bucket, as a multiple of the number of
+ * names: the last few buckets placed take about that many tries each (v3's
+ * worst takes 15). Hostile names may never fit, so a failed search stays a
+ * small multiple of the work of a successful one.
+ */
+#define NAME_DISP_TRIES 64
+/* Each attempt after the first halves the names per bucket */
+#define NAME_INDEX_ATTEMPTS 3
+
+static bool event_name_is(const struct catalog_model *m, size_t row,
+		const char *name, size_t len)
+{
+	return model_name_len(m, m->events.name[row]) == len
+		&& !memcmp(model_str(m, m->events.name[row]), name, len);
+}
+
+static bool event_name_eq(const struct catalog_model *m, size_t a, size_t b)
+{
+	catalog_str_id s = m->events.name[a];
+	return event_name_is(m, b, model_str(m, s), model_name_len(m, s));
+}
+
+struct name_key {
+	uint64_t hash;
+	uint32_t row;
+	uint32_t bucket;
+};
+
+static int name_hash_cmp(const void *a_, const void *b_)
+{
+	const struct name_key *a = a_, *b = b_;
+	if (a->hash != b->hash)
+		return a->hash < b->hash ? -1 : 1;
+	return a->row < b->row ? -1 : a->row > b->row;
+}
+
+static int name_key_cmp(const void *a_, const void *b_)
+{
+	const struct name_key *a = a_, *b = b_;
+	if (a->bucket != b->bucket)
+		return a->bucket < b->bucket ? -1 : 1;
+	return a->row < b->row ? -1 : a->row > b->row;
+}
+
+struct name_bucket {
+	uint32_t first;	/* into the sorted keys */
+	uint32_t count;
+};
+
+/* Largest buckets are the hardest to place, so they go first */
+static int name_bucket_cmp(const void *a_, const void *b_)
+{
+	const struct name_bucket *a = a_, *b = b_;
+	return a->count > b->count ? -1 : a->count < b->count;
+}
+
+/*
+ * Spread the @n @keys over @nr_buckets @buckets (zeroed) and find each a
+ * displacement into m->name_disp. Returns false if some bucket won't fit.
+ */
+static bool place_names(struct catalog_model *m, struct name_key *keys, size_t n,
+		struct name_bucket *buckets, size_t nr_buckets)
+{
+	uint32_t disp_max = NAME_DISP_TRIES * n;
+	size_t i, j;
+
+	for (i = 0; i < n; i++)
+		keys[i].bucket = catalog_name_bucket(keys[i].hash, nr_buckets);
+	qsort(keys, n, sizeof(*keys), name_key_cmp);
+
+	for (i = n; i-- > 0;) {
+		buckets[keys[i].bucket].first = i;
+		buckets[keys[i].bucket].count++;
+	}
+	qsort(buckets, nr_buckets, sizeof(*buckets), name_bucket_cmp);
+
+	for (i = 0; i < n; i++)
+		m->name_slot[i] = UINT32_MAX;
+
+	for (i = 0; i < nr_buckets && buckets[i].count; i++) {
+		const struct name_key *k = &keys[buckets[i].first];
+		uint32_t disp;
+
+		for (disp = 0; disp < disp_max; disp++) {
+			/* claim slots as we go, releasing them if the bucket won't fit */
+			for (j = 0; j < buckets[i].count; j++) {
+				size_t s = catalog_name_slot(k[j].hash, disp, n);
+				if (m->name_slot[s] != UINT32_MAX)
+					break;
+				m->name_slot[s] = k[j].row;
+			}
+			if (j == buckets[i].count)
+				break;
+			while (j-- > 0)
+				m->name_slot[catalog_name_slot(k[j].hash, disp, n)] = UINT32_MAX;
+		}
+
+		if (disp == disp_max) {
+			pr_debug(1, "no displacement places a bucket of %u names in %zu buckets",
+					buckets[i].count, nr_buckets);
+			return false;
+		}
+		m->name_disp[k->bucket] = disp;
+	}
+	return true;
+}
+
+int model_index_event_names(struct catalog_model *m)
+{
+	struct name_key *keys;
+	struct name_bucket *buckets = NULL;
+	size_t i, j, n = 0, nr_buckets;
+	unsigned attempt;
+	int r = -1;
+
+	m->name_disp = m->name_slot = NULL;
+	m->nr_name_disp = m->nr_name_slot = 0;
+
+	keys = malloc(sizeof(*keys) * (m->nr_events + 1));
+	if (!keys)
+		err(1, "alloc failure %zu", sizeof(*keys) * (m->nr_events + 1));
+
+	for (i = 0; i < m->nr_events; i++) {
+		if (m->events.skipped[i])
+			continue;
+		catalog_str_id s = m->events.name[i];
+		keys[n++] = (struct name_key) {
+			catalog_name_hash(model_str(m, s), model_name_len(m, s)), i, 0
+		};
+	}
+	qsort(keys, n, sizeof(*keys), name_hash_cmp);
+
+	/*
+	 * Repeated names can never be separated, keep the first of each.
+	 * Neither can distinct names that hash alike, so give up on those.
+	 */
+	for (i = 0, j = 0; i < n; i++) {
+		if (j && keys[j - 1].hash == keys[i].hash) {
+			if (!event_name_eq(m, keys[j - 1].row, keys[i].row)) {
+				pr_debug(1, "events %u and %u have names that hash alike",
+						keys[j - 1].row, keys[i].row);
+				goto out;
+			}
+			pr_debug(2, "event %u repeats the name of an earlier event", keys[i].row);
+			continue;
+		}
+		keys[j++] = keys[i];
+	}
+	n = j;
+
+	buckets = malloc(sizeof(*buckets) * max(n, (size_t)1));
+	if (!buckets)
+		err(1, "alloc failure for the name index of %zu events", n);
+	m->name_slot = arena_alloc(&m->arena, sizeof(*m->name_slot) * (n + 1));
+
+	for (attempt = 0; attempt < NAME_INDEX_ATTEMPTS; attempt++) {
+		nr_buckets = max(n / (NAMES_PER_BUCKET >> attempt), (size_t)1);
+		m->name_disp = arena_zalloc(&m->arena, sizeof(*m->name_disp) * nr_buckets);
+		memset(buckets, 0, sizeof(*buckets) * nr_buckets);
+		if (place_names(m, keys, n, buckets, nr_buckets)) {
+			m->nr_name_disp = nr_buckets;
+			m->nr_name_slot = n;
+			r = 0;
+			goto out;
+		}
+	}
+	m->name_disp = m->name_slot = NULL;
+out:
+	free(buckets);
+	free(keys);
+	return r;
+}
+
+size_t model_index_groups(struct catalog_model *m)
+{
+	unsigned nr_event_ixs = be_to_cpu(m->p0.event_entry_count);
+	unsigned nr_group_ixs = be_to_cpu(m->p0.group_entry_count);
+	size_t g, ev, k, n = 0, bad = 0;
+	uint32_t *fill, *row_of;
+
+	m->group_event_start = arena_alloc(&m->arena,
+			sizeof(*m->group_event_start) * (m->nr_groups + 1));
+	m->group_event = arena_alloc(&m->arena, sizeof(*m->group_event) * (m->nr_groups * 16 + 1));
+	m->event_group_start = arena_zalloc(&m->arena,
+			sizeof(*m->event_group_start) * (m->nr_events + 1));
+	fill = malloc(sizeof(*fill) * (m->nr_events + 1));
+	row_of = malloc(sizeof(*row_of) * (nr_event_ixs + 1));
+	if (!fill || !row_of)
+		err(1, "alloc failure for the group index");
+
+	/* groups name events by catalog index, which only matches the row if none were lost */
+	for (k = 0; k < nr_event_ixs; k++)
+		row_of[k] = UINT32_MAX;
+	for (ev = m->nr_events; ev-- > 0;)
+		if (m->events.index[ev] < nr_event_ixs)
+			row_of[m->events.index[ev]] = ev;
+
+	/* group -> events, counting each event's groups as we go */
+	for (g = 0; g < m->nr_groups; g++) {
+		const struct catalog_group *grp = &m->groups[g];
+		size_t count = grp->event_count;
+
+		m->group_event_start[g] = n;
+		if (count > ARRAY_SIZE(grp->event_ixs)) {
+			pr_debug(1, "group %u claims %zu events, only %zu fit",
+					grp->index, count, ARRAY_SIZE(grp->event_ixs));
+			bad++;
+			count = ARRAY_SIZE(grp->event_ixs);
+		}
+
+		for (k = 0; k < count; k++) {
+			unsigned ix = grp->event_ixs[k];
+			if (ix == UINT16_MAX) {
+				/* firmware marks unused slots this way */
+				pr_debug(2, "group %u event %zu is unused", grp->index, k);
+				continue;
+			}
+			if (ix >= nr_event_ixs) {
+				pr_debug(1, "group %u event %zu is %u, but there are only %u events",
+						grp->index, k, ix, nr_event_ixs);
+				bad++;
+				continue;
+			}
+			if (row_of[ix] == UINT32_MAX) {
+				pr_debug(1, "group %u event %u was not decoded", grp->index, ix);
+				continue;
+			}
+			m->group_event[n++] = row_of[ix];
+			m->event_group_start[row_of[ix] + 1]++;
+		}
+	}
+	m->group_event_start[g] = n;
+
+	/* event -> groups is the transpose */
+	for (ev = 0; ev < m->nr_events; ev++)
+		m->event_group_start[ev + 1] += m->event_group_start[ev];
+	memcpy(fill, m->event_group_start, sizeof(*fill) * (m->nr_events + 1));
+
+	m->event_group = arena_alloc(&m->arena, sizeof(*m->event_group) * (n + 1));
+	for (g = 0; g < m->nr_groups; g++)
+		for (k = m->group_event_start[g]; k < m->group_event_start[g + 1]; k++)
+			m->event_group[fill[m->group_event[k]]++] = g;
+	free(row_of);
+	free(fill);
+
+	for (ev = 0; ev < m->nr_events; ev++) {
+		const struct catalog_events *e = &m->events;
+		if (e->skipped[ev])
+			continue;
+		if (e->primary_group_ix[ev] >= nr_group_ixs) {
+			pr_debug(1, "event %u primary group is %u, but there are only %u groups",
+					e->index[ev], e->primary_group_ix[ev], nr_group_ixs);
+			bad++;
+		}
+		if (e->group_count[ev] != m->event_group_start[ev + 1] - m->event_group_start[ev])
+			pr_debug(2, "event %u claims %u groups, %u list it", e->index[ev],
+					e->group_count[ev],
+					m->event_group_start[ev + 1] - m->event_group_start[ev]);
+	}
+
+	return bad;
+}
+
+static int counter_cmp(const void *a_, const void *b_)
+{
+	const struct catalog_counter *a = a_, *b = b_;
+	if (a->domain != b->domain)
+		return a->domain < b->domain ? -1 : 1;
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+	return a->row < b->row ? -1 : a->row > b->row;
+}
+
+void model_index_counters(struct catalog_model *m)
+{
+	const struct catalog_events *e = &m->events;
+	size_t i, n = 0;
+
+	m->counters = arena_alloc(&m->arena, sizeof(*m->counters) * (m->nr_events + 1));
+
+	for (i = 0; i < m->nr_events; i++) {
+		if (e->skipped[i])
+			continue;
+		m->counters[n++] = (struct catalog_counter) {
+			.offset = e->counter_offs[i] + e->group_record_offs[i],
+			.domain = e->domain[i],
+			.row = i,
+		};
+	}
+
+	qsort(m->counters, n, sizeof(*m->counters), counter_cmp);
+	m->nr_counters = n;
+}
+
+ssize_t model_find_counter(const struct catalog_model *m, unsigned domain, uint32_t offset)
+{
+	struct catalog_counter key = { offset, domain, 0 };
+	size_t lo = 0, hi = m->nr_counters;
+
+	/* the first counter not before @key */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (counter_cmp(&m->counters[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == m->nr_counters || m->counters[lo].domain != domain
+			|| m->counters[lo].offset != offset)
+		return -1;
+	return m->counters[lo].row;
+}
+
+ssize_t model_find_event(const struct catalog_model *m, const char *name, size_t len)
+{
+	size_t i;
+
+	if (m->nr_name_slot) {
+		uint64_t h = catalog_name_hash(name, len);
+		uint32_t disp = m->name_disp[catalog_name_bucket(h, m->nr_name_disp)];
+		size_t row = m->name_slot[catalog_name_slot(h, disp, m->nr_name_slot)];
+
+		if (row >= m->nr_events || m->events.skipped[row]
+				|| !event_name_is(m, row, name, len))
+			return -1;
+		return row;
+	}
+
+	for (i = 0; i < m->nr_events; i++)
+		if (!m->events.skipped[i] && event_name_is(m, i, name, len))
+			return i;
+	return -1;
+}
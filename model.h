@@ -0,0 +1,326 @@
+#ifndef CATALOG_MODEL_H_
+#define CATALOG_MODEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define __packed __attribute__((__packed__))
+#include "hv-24x7-catalog.h"
+#include "arena.h"
+
+/*
+ * The decoded (native endian) form of a catalog: everything main.c prints,
+ * with strings gathered into a single string table.
+ */
+
+/* A string in catalog_model.strtab */
+struct catalog_str {
+	uint32_t offs;
+	uint32_t len;
+};
+
+/*
+ * Strings are interned: each distinct string is stored once and named by
+ * its index in catalog_model.strs, so equal strings have equal ids.
+ */
+typedef uint32_t catalog_str_id;
+
+struct catalog_schema_field {
+	uint16_t field_enum;
+	uint16_t offs;
+	uint16_t length;
+	uint16_t flags;
+};
+
+struct catalog_schema {
+	uint32_t index;		/* position in the schema section */
+	uint32_t offset;	/* byte offset in the schema section */
+	uint16_t length;
+	uint16_t descriptor;
+	uint16_t version_id;
+	uint16_t field_entry_count;
+	uint32_t first_field;	/* into catalog_model.fields */
+	uint32_t nr_fields;	/* fields actually present within length */
+};
+
+struct catalog_group {
+	uint32_t index;
+	uint32_t offset;
+	uint32_t flags;
+	uint16_t length;
+	uint8_t domain;
+	uint8_t schema_ix;
+	uint16_t group_record_offs;
+	uint16_t group_record_len;
+	uint16_t event_ixs[16];
+	uint8_t event_count;
+	catalog_str_id name, desc;
+};
+
+/*
+ * Events are stored a column per field, so a pass over one field of every
+ * event (eg: matching counter offsets) reads only that field. Row i of each
+ * column belongs to the same event. C(type, name) is expanded per column.
+ */
+#define CATALOG_EVENT_COLUMNS(C)					\
+	C(uint32_t, index)						\
+	C(uint32_t, offset)						\
+	C(uint16_t, length)						\
+	C(uint8_t, domain)						\
+	C(bool, skipped)	/* nothing decoded: no group record, or damaged */ \
+	C(uint16_t, group_record_offs)					\
+	C(uint16_t, group_record_len)					\
+	C(uint16_t, counter_offs)					\
+	C(uint32_t, flags)						\
+	C(uint16_t, primary_group_ix)					\
+	C(uint16_t, group_count)					\
+	C(catalog_str_id, name)						\
+	C(catalog_str_id, desc)						\
+	C(catalog_str_id, long_desc)
+
+struct catalog_events {
+#define C(type, name) type *name;
+	CATALOG_EVENT_COLUMNS(C)
+#undef C
+};
+
+/*
+ * Where an event's count lands, the way perf's hv_24x7 configs name it:
+ * the domain and event_counter_offs + event_group_record_offs.
+ */
+struct catalog_counter {
+	uint32_t offset;
+	uint32_t domain;
+	uint32_t row;		/* of the event */
+};
+
+/* A word of the description index (see text.h) and where its postings are */
+struct catalog_term {
+	catalog_str_id word;
+	uint32_t first_posting;
+	uint32_t nr_postings;
+};
+
+enum catalog_text_field {
+	CATALOG_TEXT_DESC,
+	CATALOG_TEXT_LONG_DESC,
+};
+
+/* One occurrence of a word */
+struct catalog_posting {
+	uint32_t row;		/* of the event */
+	uint16_t field;		/* enum catalog_text_field */
+	uint16_t pos;		/* word number within the field */
+};
+
+struct catalog_model {
+	struct hv_24x7_catalog_page_0 p0;
+
+	struct catalog_schema *schemas;
+	size_t nr_schemas, alloc_schemas;
+	struct catalog_schema_field *fields;
+	size_t nr_fields, alloc_fields;
+	struct catalog_group *groups;
+	size_t nr_groups, alloc_groups;
+	struct catalog_events events;
+	size_t nr_events, alloc_events;
+	char *strtab;
+	size_t strtab_len, alloc_strtab;
+	struct catalog_str *strs;	/* indexed by catalog_str_id */
+	size_t nr_strs, alloc_strs;
+
+	/*
+	 * Open addressed hash of the strings (id + 1, 0 is empty) used while
+	 * interning. Never part of a cache mapping.
+	 */
+	uint32_t *str_index;
+	size_t str_index_size;
+	size_t str_mark;	/* nr_strs before the last record was added */
+
+	/* Minimal perfect hash of the event names, see model_index_event_names() */
+	uint32_t *name_disp;	/* displacement of each bucket */
+	size_t nr_name_disp;
+	uint32_t *name_slot;	/* event row held by each slot */
+	size_t nr_name_slot;
+
+	/*
+	 * Inverted index of the words of the event descriptions: terms sorted
+	 * by word, each with postings sorted by row, field, then position.
+	 */
+	struct catalog_term *terms;
+	size_t nr_terms;
+	struct catalog_posting *postings;
+	size_t nr_postings;
+
+	/*
+	 * Group membership in both directions (compressed sparse rows, see
+	 * model_index_groups()). Never part of a cache mapping.
+	 */
+	uint32_t *group_event_start;	/* nr_groups + 1 entries */
+	uint16_t *group_event;		/* event rows */
+	uint32_t *event_group_start;	/* nr_events + 1 entries */
+	uint16_t *event_group;		/* group rows */
+
+	/* Sorted by domain, then offset. Never part of a cache mapping. */
+	struct catalog_counter *counters;
+	size_t nr_counters;
+
+	/*
+	 * Holds every table that isn't in a cache mapping, so the model is
+	 * torn down (or reset for reuse) in one go.
+	 */
+	struct arena arena;
+
+	/* Set when the tables live in a mapped cache file (see cache.h) */
+	void *map;
+	size_t map_bytes;
+};
+
+void model_init(struct catalog_model *m, const struct hv_24x7_catalog_page_0 *p0);
+void model_free(struct catalog_model *m);
+
+/*
+ * Empty @m to decode the catalog with page 0 @p0, keeping the memory it
+ * already has. For reloading catalogs over and over without going back to
+ * the allocator.
+ */
+void model_reset(struct catalog_model *m, const struct hv_24x7_catalog_page_0 *p0);
+
+/*
+ * Size @m for decoding every record of the @sections (CATALOG_SECTION_BIT()s)
+ * that page 0 lists, so the tables are allocated once, from one chunk. Not
+ * needed, just faster; skip it when records are dropped as they are walked.
+ */
+void model_reserve(struct catalog_model *m, unsigned sections);
+
+/*
+ * Decode a record that has already been validated, appending it to @m.
+ * Allocation failures are fatal.
+ */
+struct catalog_schema *model_add_schema(struct catalog_model *m,
+		struct hv_24x7_grs *schema, size_t index, size_t offset);
+struct catalog_group *model_add_group(struct catalog_model *m,
+		struct hv_24x7_group_data *group, size_t index, size_t offset);
+/* Returns the row of the new event */
+size_t model_add_event(struct catalog_model *m,
+		struct hv_24x7_event_data *event, size_t index, size_t offset);
+/*
+ * Stand in for a damaged event that salvaging stepped over, so the rows of
+ * those after it still follow their indexes. It is marked skipped.
+ */
+size_t model_add_damaged_event(struct catalog_model *m,
+		size_t index, size_t offset, size_t length);
+
+/* Intern @s (of @len bytes) alongside the catalog's own strings */
+catalog_str_id model_intern(struct catalog_model *m, const char *s, size_t len);
+
+/*
+ * Forget the most recently added record (and its fields or the strings it
+ * interned). Only valid straight after adding it.
+ */
+void model_drop_last_schema(struct catalog_model *m);
+void model_drop_last_group(struct catalog_model *m);
+void model_drop_last_event(struct catalog_model *m);
+
+/*
+ * The name hash is "hash and displace": the top half of a name's hash picks
+ * its bucket, and each bucket has a displacement, found at build time,
+ * that scatters its names into otherwise unused slots.
+ *
+ * The hash is 64 bit FNV-1a rather than hash64_stable(): --emit-c writes
+ * these functions out alongside the tables, so they are kept simple. The
+ * two copies (here and in emit.c) have to agree.
+ */
+static inline uint64_t catalog_name_hash(const char *name, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)name[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static inline size_t catalog_name_bucket(uint64_t h, size_t nr_buckets)
+{
+	return (h >> 32) % nr_buckets;
+}
+
+static inline size_t catalog_name_slot(uint64_t h, uint32_t disp, size_t nr_slots)
+{
+	h ^= disp * 0x9e3779b97f4a7c15ULL;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h % nr_slots;
+}
+
+/*
+ * Build a minimal perfect hash over the names of the (not skipped) events,
+ * so model_find_event() needs a single string compare. Where names repeat,
+ * the first event with the name is found. Returns 0, or -1 if no hash
+ * could be found (model_find_event() then falls back to a linear search).
+ */
+int model_index_event_names(struct catalog_model *m);
+
+/* Returns the row of the event named @name, or -1 if there is none */
+ssize_t model_find_event(const struct catalog_model *m, const char *name, size_t len);
+
+/*
+ * Index which events each group holds and which groups hold each event,
+ * as rows, leaving out references to events or groups beyond the counts
+ * in page 0 (model_check_xrefs() reports them) and to events that weren't
+ * decoded. Unused (0xffff) event slots are skipped. Returns the number of
+ * bad references.
+ */
+size_t model_index_groups(struct catalog_model *m);
+
+/*
+ * Index the (not skipped) events by the counter they name, so
+ * model_find_counter() is a binary search.
+ */
+void model_index_counters(struct catalog_model *m);
+
+/*
+ * Returns the row of the event counting at @offset in catalog domain
+ * @domain (the first, should several share a counter), or -1.
+ */
+ssize_t model_find_counter(const struct catalog_model *m, unsigned domain, uint32_t offset);
+
+/* The rows of the events in group @g, or of the groups holding event @ev */
+static inline size_t model_group_events(const struct catalog_model *m, size_t g,
+		const uint16_t **ixs)
+{
+	*ixs = m->group_event + m->group_event_start[g];
+	return m->group_event_start[g + 1] - m->group_event_start[g];
+}
+
+static inline size_t model_event_groups(const struct catalog_model *m, size_t ev,
+		const uint16_t **ixs)
+{
+	*ixs = m->event_group + m->event_group_start[ev];
+	return m->event_group_start[ev + 1] - m->event_group_start[ev];
+}
+
+static inline const char *model_str(const struct catalog_model *m, catalog_str_id id)
+{
+	return m->strtab + m->strs[id].offs;
+}
+
+static inline size_t model_str_len(const struct catalog_model *m, catalog_str_id id)
+{
+	return m->strs[id].len;
+}
+
+/* Catalog names (and descriptions) may carry nul padding, which isn't part of them */
+static inline size_t model_name_len(const struct catalog_model *m, catalog_str_id id)
+{
+	return strnlen(model_str(m, id), model_str_len(m, id));
+}
+
+#endif
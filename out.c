@@ -0,0 +1,130 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdbool.h>
+
+#include <penny/math.h>
+
+#include "out.h"
+
+/* A batch worker's buffer is its own, so its records need no locking */
+static __thread struct out out_buf;
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+struct out *out_start(FILE *f)
+{
+	struct out *ob = &out_buf;
+
+	/* left unfinished by a previous user, don't lose it */
+	if (ob->f && ob->f != f)
+		out_flush(ob);
+	ob->f = f;
+	return ob;
+}
+
+void out_flush(struct out *ob)
+{
+	if (ob->len)
+		fwrite(ob->buf, 1, ob->len, ob->f);
+	ob->len = 0;
+}
+
+/* For when @b doesn't fit what is left of the buffer */
+void out_bytes_slow(struct out *ob, const void *b, size_t len)
+{
+	while (len) {
+		size_t n = min(len, (size_t)OUT_BUF_SIZE);
+		memcpy(out_reserve(ob, n), b, n);
+		ob->len += n;
+		b += n;
+		len -= n;
+	}
+}
+
+/* "00" to "99", so decimal is done two digits per division */
+static const char dec_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+void out_dec(struct out *ob, uint64_t v)
+{
+	char tmp[20], *p = tmp + sizeof(tmp);
+
+	if (v < 10) {
+		out_char(ob, '0' + v);
+		return;
+	}
+
+	while (v >= 100) {
+		unsigned d = v % 100;
+		v /= 100;
+		p -= 2;
+		memcpy(p, dec_pairs + 2 * d, 2);
+	}
+	if (v >= 10) {
+		p -= 2;
+		memcpy(p, dec_pairs + 2 * v, 2);
+	} else {
+		*--p = '0' + v;
+	}
+	out_bytes(ob, p, tmp + sizeof(tmp) - p);
+}
+
+static void out_hex_digits(struct out *ob, uint64_t v, const char *digits)
+{
+	char tmp[16], *p = tmp + sizeof(tmp);
+
+	do {
+		*--p = digits[v & 0xf];
+		v >>= 4;
+	} while (v);
+	out_bytes(ob, p, tmp + sizeof(tmp) - p);
+}
+
+void out_hex(struct out *ob, uint64_t v)
+{
+	out_hex_digits(ob, v, hex_lower);
+}
+
+void out_HEX(struct out *ob, uint64_t v)
+{
+	out_hex_digits(ob, v, hex_upper);
+}
+
+/* Characters out_cstring() passes through: isprint() in the C locale, but for '"' and '\\' */
+static const bool plain[256] = {
+	[' ' ... '~'] = true,
+	['"'] = false,
+	['\\'] = false,
+};
+
+void out_cstring(struct out *ob, const void *b, size_t len)
+{
+	const unsigned char *s = b, *end = s + len;
+
+	while (s < end) {
+		const unsigned char *run = s;
+		while (s < end && plain[*s])
+			s++;
+		out_bytes(ob, run, s - run);
+
+		for (; s < end && !plain[*s]; s++) {
+			char *p = out_reserve(ob, 4);
+			p[0] = '\\';
+			p[1] = 'x';
+			p[2] = hex_lower[*s >> 4];
+			p[3] = hex_lower[*s & 0xf];
+			ob->len += 4;
+		}
+	}
+}
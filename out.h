@@ -0,0 +1,86 @@
+#ifndef CATALOG_OUT_H_
+#define CATALOG_OUT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Formatting records without a trip through stdio for each field: text is
+ * built up in a buffer belonging to the calling thread, numbers are
+ * converted by hand, and the FILE is handed the whole buffer at once.
+ *
+ *	struct out *ob = out_start(o);
+ *	out_lit(ob, "length = ");
+ *	out_dec(ob, len);
+ *	out_end(ob);
+ *
+ * Everything between out_start() and out_end() reaches @o in one fwrite()
+ * (or a few, should it not fit the buffer), so text written to @o directly
+ * before or after stays in order. Nothing is to be written to @o directly
+ * in between.
+ */
+#define OUT_BUF_SIZE (64 * 1024)
+
+struct out {
+	FILE *f;
+	size_t len;
+	char buf[OUT_BUF_SIZE];
+};
+
+struct out *out_start(FILE *f);
+void out_flush(struct out *ob);
+
+static inline void out_end(struct out *ob)
+{
+	out_flush(ob);
+	ob->f = NULL;
+}
+
+/* Room for @n (no more than OUT_BUF_SIZE) bytes, to be claimed by moving len */
+static inline char *out_reserve(struct out *ob, size_t n)
+{
+	if (ob->len + n > OUT_BUF_SIZE)
+		out_flush(ob);
+	return ob->buf + ob->len;
+}
+
+void out_bytes_slow(struct out *ob, const void *b, size_t len);
+
+static inline void out_bytes(struct out *ob, const void *b, size_t len)
+{
+	if (len > OUT_BUF_SIZE - ob->len) {
+		out_bytes_slow(ob, b, len);
+		return;
+	}
+	memcpy(ob->buf + ob->len, b, len);
+	ob->len += len;
+}
+
+static inline void out_char(struct out *ob, char c)
+{
+	*out_reserve(ob, 1) = c;
+	ob->len++;
+}
+
+static inline void out_str(struct out *ob, const char *s)
+{
+	out_bytes(ob, s, strlen(s));
+}
+
+/* For string literals, whose length is known at compile time */
+#define out_lit(ob, s) out_bytes(ob, s, sizeof(s) - 1)
+
+/* Decimal, and hex without a leading 0x, like %u, %x and %X */
+void out_dec(struct out *ob, uint64_t v);
+void out_hex(struct out *ob, uint64_t v);
+void out_HEX(struct out *ob, uint64_t v);
+
+/*
+ * @b as the inside of a C string: printable characters other than '"' and
+ * '\\' as they are, everything else (nul padding included) as \xNN.
+ */
+void out_cstring(struct out *ob, const void *b, size_t len);
+
+#endif
@@ -0,0 +1,403 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <ccan/err/err.h>
+#include <ccan/array_size/array_size.h>
+
+#include <penny/math.h>
+
+#include "model.h"
+#include "select.h"
+
+/*
+ * Patterns become a run of items, one per (possibly repeated) character
+ * class, ending in an accepting item. Automaton state i means "about to
+ * match item i", so a set of states is a bitmap over every item of every
+ * pattern.
+ */
+enum sel_rep {
+	SEL_ONE,
+	SEL_STAR,	/* zero or more */
+	SEL_OPT,	/* zero or one */
+	SEL_ACCEPT,
+};
+
+struct sel_item {
+	enum sel_rep rep;
+	uint64_t class[4];	/* bitmap of matching bytes */
+};
+
+struct selector {
+	struct sel_item *items;
+	size_t nr_items, alloc_items;
+	size_t words;		/* in a state set */
+	uint64_t *start;
+};
+
+static void class_add(struct sel_item *it, unsigned char c)
+{
+	it->class[c / 64] |= 1ULL << (c % 64);
+}
+
+static bool class_has(const struct sel_item *it, unsigned char c)
+{
+	return it->class[c / 64] & (1ULL << (c % 64));
+}
+
+static struct sel_item *item_add(struct selector *s, enum sel_rep rep)
+{
+	if (s->nr_items == s->alloc_items) {
+		size_t n = s->alloc_items ? s->alloc_items * 2 : 64;
+		struct sel_item *ni = realloc(s->items, n * sizeof(*ni));
+		if (!ni)
+			err(1, "alloc failure %zu", n * sizeof(*ni));
+		s->items = ni;
+		s->alloc_items = n;
+	}
+
+	struct sel_item *it = &s->items[s->nr_items++];
+	memset(it, 0, sizeof(*it));
+	it->rep = rep;
+	return it;
+}
+
+/* Parse the [...] class starting at @p into @it, returns the char after it */
+static const char *parse_class(const char *p, struct sel_item *it)
+{
+	bool negate = false;
+	unsigned c;
+
+	p++;
+	if (*p == '!' || *p == '^') {
+		negate = true;
+		p++;
+	}
+
+	/* a leading ']' is literal */
+	do {
+		if (!*p)
+			return NULL;
+		unsigned char lo = *p++, hi = lo;
+		if (*p == '-' && p[1] && p[1] != ']') {
+			hi = p[1];
+			p += 2;
+		}
+		for (c = lo; c <= hi; c++)
+			class_add(it, c);
+	} while (*p != ']');
+
+	if (negate)
+		for (c = 0; c < ARRAY_SIZE(it->class); c++)
+			it->class[c] = ~it->class[c];
+	return p + 1;
+}
+
+static void class_any(struct sel_item *it)
+{
+	memset(it->class, 0xff, sizeof(it->class));
+}
+
+static int compile_glob(struct selector *s, const char *p)
+{
+	while (*p) {
+		struct sel_item *it;
+		switch (*p) {
+		case '*':
+			class_any(item_add(s, SEL_STAR));
+			p++;
+			break;
+		case '?':
+			class_any(item_add(s, SEL_ONE));
+			p++;
+			break;
+		case '[':
+			p = parse_class(p, item_add(s, SEL_ONE));
+			if (!p)
+				return -1;
+			break;
+		case '\\':
+			if (!p[1])
+				return -1;
+			p++;
+			/* fall through */
+		default:
+			it = item_add(s, SEL_ONE);
+			class_add(it, *p++);
+		}
+	}
+
+	item_add(s, SEL_ACCEPT);
+	return 0;
+}
+
+static int compile_regex(struct selector *s, const char *p)
+{
+	bool anchored_end = false;
+
+	while (*p) {
+		struct sel_item *it;
+
+		if (*p == '$' && !p[1]) {
+			anchored_end = true;
+			break;
+		}
+
+		switch (*p) {
+		case '.':
+			class_any(it = item_add(s, SEL_ONE));
+			p++;
+			break;
+		case '[':
+			p = parse_class(p, it = item_add(s, SEL_ONE));
+			if (!p)
+				return -1;
+			break;
+		case '*':
+		case '+':
+		case '?':
+			/* a quantifier with nothing to repeat */
+			return -1;
+		case '\\':
+			if (!p[1])
+				return -1;
+			p++;
+			/* fall through */
+		default:
+			it = item_add(s, SEL_ONE);
+			class_add(it, *p++);
+		}
+
+		switch (*p) {
+		case '*':
+			it->rep = SEL_STAR;
+			p++;
+			break;
+		case '?':
+			it->rep = SEL_OPT;
+			p++;
+			break;
+		case '+': {
+			/* x+ is xx* */
+			struct sel_item *star = item_add(s, SEL_STAR);
+			memcpy(star->class, s->items[s->nr_items - 2].class, sizeof(star->class));
+			p++;
+			break;
+		}
+		}
+	}
+
+	if (!anchored_end)
+		class_any(item_add(s, SEL_STAR));
+	item_add(s, SEL_ACCEPT);
+	return 0;
+}
+
+/* Add state @i, and the states reachable from it without consuming input */
+static void state_add(const struct selector *s, uint64_t *set, size_t i)
+{
+	for (;;) {
+		set[i / 64] |= 1ULL << (i % 64);
+		if (s->items[i].rep != SEL_STAR && s->items[i].rep != SEL_OPT)
+			break;
+		i++;
+	}
+}
+
+/* @to = the states @from reaches on @c. Returns false if there are none. */
+static bool states_step(const struct selector *s, const uint64_t *from,
+		uint64_t *to, unsigned char c)
+{
+	size_t w;
+	bool any = false;
+
+	memset(to, 0, s->words * sizeof(*to));
+	for (w = 0; w < s->words; w++) {
+		uint64_t bits = from[w];
+		while (bits) {
+			size_t i = w * 64 + __builtin_ctzll(bits);
+			const struct sel_item *it = &s->items[i];
+			bits &= bits - 1;
+
+			if (it->rep == SEL_ACCEPT || !class_has(it, c))
+				continue;
+			state_add(s, to, it->rep == SEL_STAR ? i : i + 1);
+			any = true;
+		}
+	}
+
+	return any;
+}
+
+static bool states_accept(const struct selector *s, const uint64_t *set)
+{
+	size_t w;
+	for (w = 0; w < s->words; w++) {
+		uint64_t bits = set[w];
+		while (bits) {
+			size_t i = w * 64 + __builtin_ctzll(bits);
+			if (s->items[i].rep == SEL_ACCEPT)
+				return true;
+			bits &= bits - 1;
+		}
+	}
+	return false;
+}
+
+struct selector *selector_compile(const char *const *patterns, size_t nr)
+{
+	struct selector *s = calloc(1, sizeof(*s));
+	size_t i, *starts = malloc(sizeof(*starts) * (nr + 1));
+	if (!s || !starts)
+		err(1, "alloc failure compiling %zu patterns", nr);
+
+	for (i = 0; i < nr; i++) {
+		const char *p = patterns[i];
+		starts[i] = s->nr_items;
+		if (p[0] == '^' ? compile_regex(s, p + 1) : compile_glob(s, p)) {
+			free(starts);
+			selector_free(s);
+			errno = EINVAL;
+			return NULL;
+		}
+	}
+
+	s->words = (s->nr_items + 63) / 64;
+	s->start = calloc(s->words + 1, sizeof(*s->start));
+	if (!s->start)
+		err(1, "alloc failure compiling %zu patterns", nr);
+	for (i = 0; i < nr; i++)
+		state_add(s, s->start, starts[i]);
+
+	free(starts);
+	return s;
+}
+
+void selector_free(struct selector *s)
+{
+	if (!s)
+		return;
+	free(s->items);
+	free(s->start);
+	free(s);
+}
+
+static size_t name_len(const struct catalog_model *m, size_t row)
+{
+	return model_name_len(m, m->events.name[row]);
+}
+
+/* qsort() has no context argument, and batches parse a catalog per thread */
+static __thread const struct catalog_model *sort_model;
+
+static int row_name_cmp(const void *a_, const void *b_)
+{
+	uint32_t a = *(const uint32_t *)a_, b = *(const uint32_t *)b_;
+	size_t la = name_len(sort_model, a), lb = name_len(sort_model, b);
+	int r = memcmp(model_str(sort_model, sort_model->events.name[a]),
+			model_str(sort_model, sort_model->events.name[b]), min(la, lb));
+	if (r)
+		return r;
+	if (la != lb)
+		return la < lb ? -1 : 1;
+	return a < b ? -1 : a > b;
+}
+
+void select_names_build(struct select_names *n, const struct catalog_model *m)
+{
+	size_t i, k = 0;
+
+	memset(n, 0, sizeof(*n));
+	n->rows = malloc(sizeof(*n->rows) * (m->nr_events + 1));
+	n->lcp = malloc(sizeof(*n->lcp) * (m->nr_events + 1));
+	if (!n->rows || !n->lcp)
+		err(1, "alloc failure for the names of %zu events", m->nr_events);
+
+	for (i = 0; i < m->nr_events; i++)
+		if (!m->events.skipped[i])
+			n->rows[k++] = i;
+	n->nr = k;
+
+	sort_model = m;
+	qsort(n->rows, n->nr, sizeof(*n->rows), row_name_cmp);
+
+	for (i = 0; i < n->nr; i++) {
+		const char *a = model_str(m, m->events.name[n->rows[i]]);
+		size_t la = name_len(m, n->rows[i]), l = 0;
+
+		n->max_len = max(n->max_len, la);
+		if (i) {
+			const char *b = model_str(m, m->events.name[n->rows[i - 1]]);
+			size_t lb = name_len(m, n->rows[i - 1]);
+			while (l < la && l < lb && a[l] == b[l])
+				l++;
+		}
+		n->lcp[i] = l;
+	}
+}
+
+void select_names_free(struct select_names *n)
+{
+	free(n->rows);
+	free(n->lcp);
+	memset(n, 0, sizeof(*n));
+}
+
+static int row_cmp(const void *a_, const void *b_)
+{
+	uint32_t a = *(const uint32_t *)a_, b = *(const uint32_t *)b_;
+	return a < b ? -1 : a > b;
+}
+
+size_t selector_run(const struct selector *s, const struct select_names *n,
+		const struct catalog_model *m, uint32_t *rows)
+{
+	/* sets[d] holds the states after the first d bytes of the current name */
+	uint64_t *sets = malloc(sizeof(*sets) * (s->words * (n->max_len + 1) + 1));
+	size_t i, d, valid = 0, found = 0;
+	if (!sets)
+		err(1, "alloc failure running %zu pattern items", s->nr_items);
+	memcpy(sets, s->start, sizeof(*sets) * s->words);
+
+	for (i = 0; i < n->nr; i++) {
+		const char *name = model_str(m, m->events.name[n->rows[i]]);
+		size_t len = name_len(m, n->rows[i]);
+		bool dead = false;
+
+		/* the prefix shared with the previous name was already run */
+		for (d = min(valid, (size_t)n->lcp[i]); d < len; d++) {
+			if (!states_step(s, sets + d * s->words, sets + (d + 1) * s->words,
+					name[d])) {
+				dead = true;
+				break;
+			}
+		}
+
+		if (dead) {
+			/* so is every following name with this prefix */
+			valid = d + 1;
+			while (i + 1 < n->nr && n->lcp[i + 1] >= valid)
+				i++;
+			continue;
+		}
+
+		valid = len;
+		if (states_accept(s, sets + len * s->words))
+			rows[found++] = n->rows[i];
+	}
+
+	free(sets);
+	qsort(rows, found, sizeof(*rows), row_cmp);
+	return found;
+}
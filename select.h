@@ -0,0 +1,45 @@
+#ifndef CATALOG_SELECT_H_
+#define CATALOG_SELECT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct catalog_model;
+
+/*
+ * A set of event name patterns compiled into one automaton. Each pattern
+ * is either a glob (*, ?, and [...] classes, matching the whole name) or,
+ * when it starts with '^', an anchored regex: literals, '.', [...] classes
+ * and \-escapes, each optionally followed by *, + or ?, matching a prefix
+ * of the name unless it ends in '$'. There is no alternation or grouping.
+ */
+struct selector;
+
+/* Returns NULL with errno = EINVAL if a pattern is malformed */
+struct selector *selector_compile(const char *const *patterns, size_t nr);
+void selector_free(struct selector *s);
+
+/*
+ * The event names of a model sorted, with the length of the prefix each
+ * shares with the one before it: a flattened prefix trie.
+ */
+struct select_names {
+	uint32_t *rows;
+	uint32_t *lcp;
+	size_t nr;
+	size_t max_len;
+};
+
+void select_names_build(struct select_names *n, const struct catalog_model *m);
+void select_names_free(struct select_names *n);
+
+/*
+ * Store the rows of the events whose names match any pattern of @s in
+ * @rows (which has room for every event), in row order. Each shared name
+ * prefix is run through the automaton once, and names are skipped as soon
+ * as their prefix can no longer match. Returns the number of rows stored.
+ */
+size_t selector_run(const struct selector *s, const struct select_names *n,
+		const struct catalog_model *m, uint32_t *rows);
+
+#endif
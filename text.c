@@ -0,0 +1,370 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+#include <ccan/err/err.h>
+#include <ccan/pr_debug/pr_debug.h>
+#include <ccan/array_size/array_size.h>
+
+#include <penny/math.h>
+
+#include "model.h"
+#include "text.h"
+
+/*
+ * The next word of @s (@len bytes) at or after *@i, lowered into @w.
+ * Returns its length (at most TEXT_WORD_MAX), or 0 if there are no more.
+ */
+static size_t next_word(const char *s, size_t len, size_t *i, char *w)
+{
+	size_t n = 0;
+
+	while (*i < len && !isalnum((unsigned char)s[*i]))
+		(*i)++;
+	for (; *i < len && isalnum((unsigned char)s[*i]); (*i)++)
+		if (n < TEXT_WORD_MAX)
+			w[n++] = tolower((unsigned char)s[*i]);
+	return n;
+}
+
+static int word_cmp(const struct catalog_model *m, catalog_str_id id,
+		const char *w, size_t len)
+{
+	size_t l = model_str_len(m, id);
+	int r = memcmp(model_str(m, id), w, min(l, len));
+	if (r)
+		return r;
+	return l < len ? -1 : l > len;
+}
+
+struct occurrence {
+	catalog_str_id word;
+	struct catalog_posting p;
+};
+
+static int occurrence_cmp(const void *a_, const void *b_)
+{
+	const struct occurrence *a = a_, *b = b_;
+
+	if (a->word != b->word)
+		return a->word < b->word ? -1 : 1;
+	if (a->p.row != b->p.row)
+		return a->p.row < b->p.row ? -1 : 1;
+	if (a->p.field != b->p.field)
+		return a->p.field < b->p.field ? -1 : 1;
+	return a->p.pos < b->p.pos ? -1 : a->p.pos > b->p.pos;
+}
+
+/* The strings term_cmp() compares, per thread as batch workers each build an index */
+static __thread const struct catalog_model *sort_model;
+
+static int term_cmp(const void *a_, const void *b_)
+{
+	const struct catalog_term *a = a_, *b = b_;
+	return word_cmp(sort_model, a->word,
+			model_str(sort_model, b->word), model_str_len(sort_model, b->word));
+}
+
+void text_index_build(struct catalog_model *m)
+{
+	struct occurrence *occ = NULL;
+	size_t i, j, nr_occ = 0, alloc_occ = 0;
+	char w[TEXT_WORD_MAX];
+
+	for (i = 0; i < m->nr_events; i++) {
+		const catalog_str_id fields[] = {
+			[CATALOG_TEXT_DESC] = m->events.desc[i],
+			[CATALOG_TEXT_LONG_DESC] = m->events.long_desc[i],
+		};
+		unsigned f;
+
+		if (m->events.skipped[i])
+			continue;
+
+		for (f = 0; f < ARRAY_SIZE(fields); f++) {
+			const char *s = model_str(m, fields[f]);
+			size_t len = model_name_len(m, fields[f]), at = 0, n;
+			uint16_t pos = 0;
+
+			while ((n = next_word(s, len, &at, w))) {
+				if (nr_occ == alloc_occ) {
+					alloc_occ = alloc_occ ? alloc_occ * 2 : 1024;
+					occ = realloc(occ, sizeof(*occ) * alloc_occ);
+					if (!occ)
+						err(1, "alloc failure %zu", sizeof(*occ) * alloc_occ);
+				}
+				occ[nr_occ++] = (struct occurrence) {
+					.word = model_intern(m, w, n),
+					.p = { i, f, pos++ },
+				};
+			}
+		}
+	}
+
+	if (nr_occ)
+		qsort(occ, nr_occ, sizeof(*occ), occurrence_cmp);
+
+	size_t nr_terms = 0;
+	for (i = 0; i < nr_occ; i++)
+		nr_terms += !i || occ[i].word != occ[i - 1].word;
+
+	m->postings = arena_alloc(&m->arena, sizeof(*m->postings) * nr_occ);
+	m->terms = arena_alloc(&m->arena, sizeof(*m->terms) * nr_terms);
+
+	m->nr_terms = 0;
+	for (i = 0; i < nr_occ; i = j) {
+		for (j = i; j < nr_occ && occ[j].word == occ[i].word; j++)
+			m->postings[j] = occ[j].p;
+		m->terms[m->nr_terms++] = (struct catalog_term) { occ[i].word, i, j - i };
+	}
+	m->nr_postings = nr_occ;
+	free(occ);
+
+	sort_model = m;
+	qsort(m->terms, m->nr_terms, sizeof(*m->terms), term_cmp);
+	pr_debug(2, "indexed %zu words, %zu distinct", m->nr_postings, m->nr_terms);
+}
+
+static const struct catalog_term *find_term(const struct catalog_model *m,
+		const char *w, size_t len)
+{
+	size_t lo = 0, hi = m->nr_terms;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int r = word_cmp(m, m->terms[mid].word, w, len);
+		if (!r)
+			return &m->terms[mid];
+		if (r < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+/* Does @t occur at @pos of @field of event @row? */
+static bool term_at(const struct catalog_model *m, const struct catalog_term *t,
+		uint32_t row, unsigned field, unsigned pos)
+{
+	const struct catalog_posting *p = m->postings + t->first_posting;
+	size_t lo = 0, hi = t->nr_postings;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct catalog_posting *q = &p[mid];
+		int r = q->row != row ? (q->row < row ? -1 : 1)
+			: q->field != field ? (q->field < field ? -1 : 1)
+			: q->pos != pos ? (q->pos < pos ? -1 : 1)
+			: 0;
+		if (!r)
+			return true;
+		if (r < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+/* Inverse document frequency: rarer words count for more */
+static double term_idf(const struct catalog_model *m, const struct catalog_term *t,
+		size_t nr_docs)
+{
+	const struct catalog_posting *p = m->postings + t->first_posting;
+	size_t i, df = 0;
+
+	for (i = 0; i < t->nr_postings; i++)
+		if (!i || p[i].row != p[i - 1].row)
+			df++;
+	return log(1 + (double)nr_docs / df);
+}
+
+static double tf_score(unsigned tf, unsigned field, double idf)
+{
+	return idf * (field == CATALOG_TEXT_DESC ? 2 : 1) * (1 + log(tf));
+}
+
+/*
+ * Words too common in English to rank anything by. They are still indexed,
+ * so phrases holding them match.
+ */
+static const char *const stop_words[] = {
+	"a", "an", "and", "are", "as", "at", "be", "by", "for", "from", "in",
+	"is", "it", "of", "on", "or", "that", "the", "to", "what", "when",
+	"where", "which", "with",
+};
+
+static bool is_stop_word(const char *w, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(stop_words); i++)
+		if (strlen(stop_words[i]) == len && !memcmp(stop_words[i], w, len))
+			return true;
+	return false;
+}
+
+struct query_word {
+	const struct catalog_term *t;	/* NULL if the word is never used */
+	unsigned phrase;		/* 0 for a bare word */
+};
+
+struct query {
+	struct query_word *words;
+	size_t nr_words;
+	unsigned nr_phrases;
+};
+
+static int query_parse(const struct catalog_model *m, const char *s,
+		struct query *q)
+{
+	size_t i = 0, len = strlen(s);
+	bool open = false;
+	char w[TEXT_WORD_MAX];
+
+	memset(q, 0, sizeof(*q));
+	q->words = malloc(sizeof(*q->words) * (len / 2 + 1));
+	if (!q->words)
+		err(1, "alloc failure");
+
+	while (i < len) {
+		if (s[i] == '"') {
+			open = !open;
+			if (open)
+				q->nr_phrases++;
+			i++;
+			continue;
+		}
+		if (!isalnum((unsigned char)s[i])) {
+			i++;
+			continue;
+		}
+
+		size_t n = next_word(s, len, &i, w);
+		if (!open && is_stop_word(w, n))
+			continue;
+		q->words[q->nr_words++] = (struct query_word) {
+			find_term(m, w, n), open ? q->nr_phrases : 0
+		};
+	}
+
+	if (open) {
+		free(q->words);
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+static int hit_cmp(const void *a_, const void *b_)
+{
+	const struct text_hit *a = a_, *b = b_;
+
+	if (a->score != b->score)
+		return a->score > b->score ? -1 : 1;
+	return a->row < b->row ? -1 : a->row > b->row;
+}
+
+ssize_t text_search(const struct catalog_model *m, const char *query,
+		struct text_hit **hits)
+{
+	struct query q;
+	size_t i, j, k, nr_docs = 0, nr_hits = 0;
+	unsigned ph, required = 0;
+
+	if (query_parse(m, query, &q))
+		return -1;
+
+	for (i = 0; i < m->nr_events; i++)
+		if (!m->events.skipped[i])
+			nr_docs++;
+
+	double *score = calloc(m->nr_events + 1, sizeof(*score));
+	/* the number of phrases each event has, and the last one it had */
+	unsigned *phrases = calloc(m->nr_events + 1, sizeof(*phrases));
+	unsigned *seen = calloc(m->nr_events + 1, sizeof(*seen));
+	if (!score || !phrases || !seen)
+		err(1, "alloc failure for %zu events", m->nr_events);
+
+	/*
+	 * Each bare word is scored on its own. A phrase is scored like a word
+	 * (with the idf of all its words) whose occurrences are those of its
+	 * first word that the rest follow.
+	 */
+	for (i = 0; i < q.nr_words; i = j) {
+		ph = q.words[i].phrase;
+		j = i + 1;
+		if (ph) {
+			while (j < q.nr_words && q.words[j].phrase == ph)
+				j++;
+			required++;
+		}
+
+		double idf = 0;
+		for (k = i; k < j; k++) {
+			if (!q.words[k].t)
+				break;
+			idf += term_idf(m, q.words[k].t, nr_docs);
+		}
+		if (k < j)
+			continue;
+
+		const struct catalog_term *t = q.words[i].t;
+		const struct catalog_posting *p = m->postings + t->first_posting, *run = NULL;
+		unsigned tf = 0;
+		size_t n;
+
+		for (n = 0; n <= t->nr_postings; n++) {
+			if (n < t->nr_postings) {
+				for (k = i + 1; k < j; k++)
+					if (!term_at(m, q.words[k].t, p[n].row, p[n].field, p[n].pos + (k - i)))
+						break;
+				if (k < j)
+					continue;
+				if (run && run->row == p[n].row && run->field == p[n].field) {
+					tf++;
+					continue;
+				}
+			}
+
+			if (run) {
+				score[run->row] += tf_score(tf, run->field, idf);
+				if (ph && seen[run->row] != ph) {
+					seen[run->row] = ph;
+					phrases[run->row]++;
+				}
+			}
+			if (n < t->nr_postings) {
+				run = &p[n];
+				tf = 1;
+			}
+		}
+	}
+
+	*hits = malloc(sizeof(**hits) * (m->nr_events + 1));
+	if (!*hits)
+		err(1, "alloc failure for %zu events", m->nr_events);
+	for (i = 0; i < m->nr_events; i++)
+		if (phrases[i] == required && score[i] > 0)
+			(*hits)[nr_hits++] = (struct text_hit) { i, score[i] };
+	qsort(*hits, nr_hits, sizeof(**hits), hit_cmp);
+
+	free(score);
+	free(phrases);
+	free(seen);
+	free(q.words);
+	return nr_hits;
+}
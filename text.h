@@ -0,0 +1,38 @@
+#ifndef CATALOG_TEXT_H_
+#define CATALOG_TEXT_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct catalog_model;
+
+/*
+ * Full text search over the descriptions and detailed descriptions of the
+ * events. Words are runs of letters and digits, compared without regard
+ * to case; only the first TEXT_WORD_MAX bytes of a word count.
+ */
+#define TEXT_WORD_MAX 64
+
+/*
+ * Fill in the model's terms and postings from the descriptions of the (not
+ * skipped) events. The words are interned into the model's strings, so
+ * this is done before the model is cached. Allocation failures are fatal.
+ */
+void text_index_build(struct catalog_model *m);
+
+struct text_hit {
+	uint32_t row;
+	double score;
+};
+
+/*
+ * Search for @query: bare words rank events (tf-idf, with words of the
+ * short description weighing double), "quoted phrases" must all appear,
+ * their words consecutive within one description. Stores the hits, best
+ * first, in *@hits (to be free()d) and returns how many there are, or -1
+ * with errno = EINVAL if a quote is left open.
+ */
+ssize_t text_search(const struct catalog_model *m, const char *query,
+		struct text_hit **hits);
+
+#endif
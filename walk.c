@@ -0,0 +1,484 @@
+/*
+ * Author: Cody P Schafer <cody@linux.vnet.ibm.com>
+ * Copyright 2014 IBM Corporation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <ccan/pr_debug/pr_debug.h>
+#include <ccan/err/err.h>
+#include <ccan/endian/endian.h>
+
+#include <penny/math.h>
+
+#include "catalog.h"
+#include "model.h"
+#include "check.h"
+#include "walk.h"
+
+/*
+ * Schema, group, and event records all lead with a __be16 length. Damaged
+ * sections can leave a record at an odd offset, so it is copied out.
+ */
+static size_t record_length(const void *rec)
+{
+	__be16 len;
+	memcpy(&len, rec, sizeof(len));
+	return be_to_cpu(len);
+}
+
+/*
+ * Does the record at @rec, with a fixed portion of @fixed bytes, fit
+ * entirely before @end?
+ */
+static bool record_fits(void *rec, size_t fixed, void *end)
+{
+	if (!record_is_within(rec, fixed + 1, end))
+		return false;
+	return record_is_within(rec, record_length(rec), end);
+}
+
+/*
+ * Is there a whole, undamaged record of at least @fixed bytes at @rec? For
+ * finding where records start again after a damaged one: records are
+ * multiples of 16 bytes long, so start 16 byte aligned within the section.
+ */
+static bool record_is_plausible(void *rec, size_t fixed, void *end)
+{
+	if (!record_is_within(rec, fixed + 1, end))
+		return false;
+	size_t len = record_length(rec);
+	return len >= fixed && IS_ALIGNED(len, 16) && record_is_within(rec, len, end);
+}
+
+static bool schema_record_is_valid(void *rec, void *end)
+{
+	return record_is_plausible(rec, sizeof(struct hv_24x7_grs), end)
+		&& schema_is_within(rec, rec + record_length(rec));
+}
+
+static bool group_record_is_valid(void *rec, void *end)
+{
+	return record_is_plausible(rec, sizeof(struct hv_24x7_group_data), end)
+		&& group_is_within(rec, rec + record_length(rec));
+}
+
+static bool event_record_is_valid(void *rec, void *end)
+{
+	struct hv_24x7_event_data *ev = rec;
+	if (!record_is_plausible(rec, offsetof(struct hv_24x7_event_data, remainder), end))
+		return false;
+
+	/*
+	 * Names and descriptions are padded to even lengths. Insisting on it
+	 * also keeps event_is_within() from warning about every misaligned
+	 * candidate.
+	 */
+	size_t len = be_to_cpu(ev->length);
+	size_t nl = be_to_cpu(ev->event_name_len);
+	if (nl < 2 || (nl & 1) || nl > len - offsetof(struct hv_24x7_event_data, remainder))
+		return false;
+	if (ev->remainder[nl - 1] & 1)
+		return false;
+	return event_is_within(ev, rec + len);
+}
+
+/* Is everything from @p to @end zero (the padding after a section's last record)? */
+static bool is_padding(const void *p, const void *end)
+{
+	const unsigned char *c;
+	for (c = p; (const void *)c < end; c++)
+		if (*c)
+			return false;
+	return true;
+}
+
+/*
+ * Salvage: step over the damaged record at @rec (at w->offset), returning
+ * where the walk picks up again, or NULL if nothing after it in @buf ending
+ * at @end looks like a record. If the damaged record's own length leads to
+ * a valid record, only it is skipped, and *@whole (if given) is set.
+ * Otherwise each 16 byte aligned offset after it is tried in turn; the
+ * records skipped that way can't be counted, so the indexes of those that
+ * follow may be too low.
+ */
+static void *salvage_record(struct section_walk *w, void *rec, void *end, size_t fixed,
+		bool (*is_valid)(void *rec, void *end), const char *what, bool *whole)
+{
+	size_t len = record_is_within(rec, fixed + 1, end) ? record_length(rec) : 0;
+	void *next = NULL;
+
+	if (whole)
+		*whole = false;
+	if (is_padding(rec, end)) {
+		pr_debug(2, "%s section padding starts at %zu", what, w->offset);
+		return NULL;
+	}
+
+	if (len >= fixed && IS_ALIGNED(len, 16) && record_is_within(rec, len, end)
+			&& is_valid(rec + len, end)) {
+		next = rec + len;
+		if (whole)
+			*whole = true;
+	} else {
+		size_t at, avail = end > rec ? (size_t)(end - rec) : 0;
+		for (at = ALIGN(w->offset + 1, 16) - w->offset; at < avail; at += 16) {
+			if (is_valid(rec + at, end)) {
+				next = rec + at;
+				break;
+			}
+		}
+	}
+
+	size_t skipped = (next ? next : end) - rec;
+	warnx("salvage: skipped damaged %s %zu, bytes %zu-%zu of the section%s", what, w->i,
+			w->offset, w->offset + skipped - 1, next ? "" : " (to the end)");
+	w->skipped_records++;
+	w->skipped_bytes += skipped;
+	w->offset += skipped;
+	return next;
+}
+
+/* Hand the printer, if any, a record's banner or the record itself */
+static void print_banner(const struct section_walk *w, enum catalog_section_id id,
+		size_t len, size_t offset)
+{
+	if (w->print && w->print->banner)
+		w->print->banner(w, id, len, offset);
+}
+
+static void print_record(const struct section_walk *w, const struct catalog_model *m,
+		enum catalog_section_id id, size_t row, const void *raw)
+{
+	if (w->print && w->print->record)
+		w->print->record(w, m, id, row, raw);
+}
+
+size_t walk_schemas(struct section_walk *w, struct catalog_model *m,
+		void *buf, size_t len, bool last)
+{
+	struct hv_24x7_grs *schema = buf;
+	void *end = buf + len;
+	for (;; w->i++) {
+		if (!last && !record_fits(schema, sizeof(*schema), end))
+			break;
+
+		if (!schema_fixed_portion_is_within(schema, end)) {
+			warnx("schema fixed portion is not within range");
+			goto damaged;
+		}
+
+		size_t offset = w->offset;
+		if (offset >= w->bytes)
+			goto done;
+
+		if (w->i >= w->count) {
+			/* Padding follows the last schema, this is expected */
+			pr_debug(2, "schema count ends before buffer end (offset=%zu, bytes remaining=%zu)\n",
+					offset, w->bytes - offset);
+			goto done;
+		}
+
+		size_t schema_len = be_to_cpu(schema->length);
+		/* lengths are supposed to be multiples of 16, only salvaging insists */
+		if (w->salvage && (schema_len ? !IS_ALIGNED(schema_len, 16) : !is_padding(schema, end))) {
+			warnx("bad schema length %zu", schema_len);
+			goto damaged;
+		}
+		print_banner(w, CATALOG_SCHEMA, schema_len, offset);
+
+		if (schema_len < sizeof(*schema)) {
+			warnx("schema length %zu is shorter than its fixed portion", schema_len);
+			goto damaged;
+		}
+
+		if (!record_is_within(schema, schema_len, end)) {
+			warnx("schema ends after schema data: schema_end=%p > end=%p", (void *)schema + schema_len, end);
+			goto damaged;
+		}
+		void *schema_end = (void *)schema + schema_len;
+
+		if (!schema_is_within(schema, end)) {
+			warnx("schema exceeds schema data length schema=%p end=%p", schema, end);
+			goto damaged;
+		}
+
+		if (!schema_is_within(schema, schema_end)) {
+			warnx("schema exceeds it's own length schema=%p end=%p", schema, schema_end);
+			goto damaged;
+		}
+
+		struct catalog_schema *s = model_add_schema(m, schema, w->i, offset);
+		print_record(w, m, CATALOG_SCHEMA, s - m->schemas, schema);
+		if (w->seen)
+			xref_see_schema(w->seen, s);
+		if (!w->keep)
+			model_drop_last_schema(m);
+
+		schema = (void *)schema + schema_len;
+		w->offset += schema_len;
+		continue;
+damaged:
+		if (!w->salvage || !(schema = salvage_record(w, schema, end, sizeof(*schema),
+						schema_record_is_valid, "schema", NULL)))
+			goto done;
+	}
+
+	return (void *)schema - buf;
+done:
+	w->done = true;
+	return len;
+}
+
+size_t walk_groups(struct section_walk *w, struct catalog_model *m,
+		void *buf, size_t len, bool last)
+{
+	struct hv_24x7_group_data *group = buf;
+	void *end = buf + len;
+	for (;; w->i++) {
+		if (!last && !record_fits(group, sizeof(*group), end))
+			break;
+
+		if (!group_fixed_portion_is_within(group, end)) {
+			warnx("group fixed portion is not within range");
+			goto damaged;
+		}
+
+		size_t offset = w->offset;
+		if (offset >= w->bytes)
+			goto done;
+
+		if (w->i >= w->count) {
+			/* Padding follows the last group, this is expected */
+			pr_debug(2, "group count ends before buffer end (offset=%zu, bytes remaining=%zu)\n",
+					offset, w->bytes - offset);
+			goto done;
+		}
+
+		size_t group_len = be_to_cpu(group->length);
+		/* lengths are supposed to be multiples of 16, only salvaging insists */
+		if (w->salvage && (group_len ? !IS_ALIGNED(group_len, 16) : !is_padding(group, end))) {
+			warnx("bad group length %zu", group_len);
+			goto damaged;
+		}
+		print_banner(w, CATALOG_GROUP, group_len, offset);
+
+		if (group_len < sizeof(*group)) {
+			warnx("group length %zu is shorter than its fixed portion", group_len);
+			goto damaged;
+		}
+
+		if (!record_is_within(group, group_len, end)) {
+			warnx("group ends after group data: group_end=%p > end=%p", (void *)group + group_len, end);
+			goto damaged;
+		}
+		void *group_end = (void *)group + group_len;
+
+		if (!group_is_within(group, end)) {
+			warnx("group exceeds group data length group=%p end=%p", group, end);
+			goto damaged;
+		}
+
+		if (!group_is_within(group, group_end)) {
+			warnx("group exceeds it's own length group=%p end=%p", group, group_end);
+			goto damaged;
+		}
+
+		struct catalog_group *g = model_add_group(m, group, w->i, offset);
+		print_record(w, m, CATALOG_GROUP, g - m->groups, group);
+		if (!w->keep)
+			model_drop_last_group(m);
+
+		group = (void *)group + group_len;
+		w->offset += group_len;
+		continue;
+damaged:
+		if (!w->salvage || !(group = salvage_record(w, group, end, sizeof(*group),
+						group_record_is_valid, "group", NULL)))
+			goto done;
+	}
+
+	return (void *)group - buf;
+done:
+	w->done = true;
+	return len;
+}
+
+size_t walk_events(struct section_walk *w, struct catalog_model *m,
+		void *buf, size_t len, bool last)
+{
+	struct hv_24x7_event_data *event = buf;
+	void *end = buf + len, *next;
+	bool whole;
+	for (;; w->i++) {
+		size_t offset = w->offset;
+		if (offset >= w->bytes)
+			goto done;
+
+		if (w->i >= w->count) {
+			/* XXX: we have padding following the last event. Completely expected. */
+			pr_debug(2, "event count ends before buffer end (offset=%zu, end=%zu bytes remaining=%zu)\n",
+					offset, w->bytes, w->bytes - offset);
+			goto done;
+		}
+
+		if (!last && !record_fits(event, offsetof(struct hv_24x7_event_data, remainder), end))
+			break;
+
+		enum event_verdict v;
+		bool crosses_page;
+		if (w->i < w->nr_checks && w->checks[w->i].offset == offset) {
+			v = w->checks[w->i].verdict;
+			crosses_page = w->checks[w->i].crosses_page;
+		} else {
+			v = event_check(event, offset, end, &crosses_page);
+		}
+
+		if (v == EVENT_FIXED_OUTSIDE) {
+			warnx("event fixed portion is not within range");
+			goto damaged;
+		}
+
+		size_t ev_len = be_to_cpu(event->length);
+		if (v == EVENT_TOO_SHORT) {
+			warnx("event length %zu is shorter than its fixed portion", ev_len);
+			goto damaged;
+		}
+		/* lengths are supposed to be multiples of 16, only salvaging insists */
+		if (w->salvage && (ev_len ? !IS_ALIGNED(ev_len, 16) : !is_padding(event, end))) {
+			warnx("bad event length %zu", ev_len);
+			goto damaged;
+		}
+
+		if (v == EVENT_SKIPPED) {
+			pr_debug(10, "invalid event, skipping\n");
+			model_add_event(m, event, w->i, offset);
+			goto next_event;
+		}
+		print_banner(w, CATALOG_EVENT, ev_len, offset);
+
+		switch (v) {
+		case EVENT_ENDS_AFTER:
+			warnx("event ends after event data: ev_end=%p > end=%p", (void *)event + ev_len, end);
+			goto damaged;
+		case EVENT_EXCEEDS_DATA:
+			warnx("event exceeds event data length event=%p end=%p", event, end);
+			goto damaged;
+		case EVENT_EXCEEDS_OWN:
+			warnx("event exceeds it's own length event=%p end=%p", event, (void *)event + ev_len);
+			goto damaged;
+		default:
+			break;
+		}
+
+		if (crosses_page)
+			warnx("event crosses page boundary");
+
+		size_t ev = model_add_event(m, event, w->i, offset);
+		print_record(w, m, CATALOG_EVENT, ev, event);
+
+next_event:
+		if (w->seen)
+			xref_see_event(w->seen, m, m->nr_events - 1);
+		if (!w->keep)
+			model_drop_last_event(m);
+		event = (void *)event + ev_len;
+		w->offset += ev_len;
+		continue;
+damaged:
+		if (!w->salvage || !(next = salvage_record(w, event, end,
+						offsetof(struct hv_24x7_event_data, remainder),
+						event_record_is_valid, "event", &whole)))
+			goto done;
+		/* still counted, so it keeps a row that those after it line up behind */
+		if (whole) {
+			model_add_damaged_event(m, w->i, offset, next - (void *)event);
+			if (w->seen)
+				xref_see_event(w->seen, m, m->nr_events - 1);
+			if (!w->keep)
+				model_drop_last_event(m);
+		}
+		event = next;
+	}
+
+	return (void *)event - buf;
+done:
+	if (w->i != w->count)
+		warnx("event buffer ended before listed # of events were parsed (got %zu, wanted %u)", w->i, w->count);
+	w->done = true;
+	return len;
+}
+
+#define STREAM_WINDOW_SIZE CATALOG_WINDOW_MIN
+
+size_t walk_section(enum catalog_section_id id, struct section_walk *w,
+		struct catalog_model *m, void *buf, size_t len, bool last)
+{
+	switch (id) {
+	case CATALOG_SCHEMA:
+		return walk_schemas(w, m, buf, len, last);
+	case CATALOG_GROUP:
+		return walk_groups(w, m, buf, len, last);
+	case CATALOG_EVENT:
+		return walk_events(w, m, buf, len, last);
+	default:
+		/* TODO: for each formula */
+		w->done = true;
+		return len;
+	}
+}
+
+int walk_stream_page(void *priv, enum catalog_section_id id, void *page, bool last)
+{
+	struct walk_stream *s = priv;
+	struct catalog_window *win = &s->win[id];
+	struct section_walk *w = &s->walk[id];
+	size_t used;
+
+	if (w->done)
+		return 0;
+
+	if (!win->buf && catalog_window_init(win, STREAM_WINDOW_SIZE))
+		return -1;
+
+	if (catalog_window_append(win, page, CATALOG_PAGE_SIZE)) {
+		/* a record bigger than any legal one, let the walker reject it */
+		last = true;
+	}
+
+	used = walk_section(id, w, s->m, win->buf, win->len, last);
+	catalog_window_consume(win, used);
+	if (w->done || last)
+		catalog_window_free(win);
+	return 0;
+}
+
+int walk_windowed(int fd, enum catalog_section_id id, unsigned page,
+		struct section_walk *w, struct catalog_model *m, struct catalog_window *win)
+{
+	win->len = 0;
+	win->offset = 0;
+
+	while (!w->done) {
+		ssize_t got = catalog_window_pread(win, fd, page, w->bytes);
+		if (got < 0)
+			return -1;
+
+		/* a record bigger than any legal one also ends up here */
+		bool last = !got || win->offset + win->len >= w->bytes;
+		catalog_window_consume(win, walk_section(id, w, m, win->buf, win->len, last));
+		if (last)
+			break;
+	}
+
+	return 0;
+}
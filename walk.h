@@ -0,0 +1,105 @@
+#ifndef CATALOG_WALK_H_
+#define CATALOG_WALK_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "catalog.h"
+#include "model.h"
+#include "check.h"
+
+/*
+ * Walking the records of a section: checking each, decoding it into a
+ * model, and optionally printing it, stepping over damaged records when
+ * salvaging. A section can be walked whole, page by page as it is
+ * streamed, or through a window that is topped up as it is consumed.
+ */
+
+struct section_walk;
+
+/*
+ * How a walk prints what it decodes. @banner (if set) comes before a record
+ * is checked, @record once it is row @row of @m; @raw is the record as it
+ * was in the section. Each goes out as soon as it is formatted, so it stays
+ * in step with any warnings about the record.
+ */
+struct walk_printer {
+	void (*banner)(const struct section_walk *w, enum catalog_section_id id,
+			size_t len, size_t offset);
+	void (*record)(const struct section_walk *w, const struct catalog_model *m,
+			enum catalog_section_id id, size_t row, const void *raw);
+};
+
+/*
+ * State for walking the records of one section. The walkers can be handed
+ * the whole section at once, or be fed it a window at a time (@last marks
+ * the window that reaches the end of the section).
+ */
+struct section_walk {
+	size_t bytes;		/* total size of the section */
+	unsigned count;		/* entry count claimed by page 0 */
+	size_t i;		/* index of the next record */
+	size_t offset;		/* section offset of the next record */
+	bool keep;		/* retain decoded records in the model */
+	bool done;
+
+	/* print records to @o as they are walked, if set */
+	const struct walk_printer *print;
+	FILE *o;
+
+	/* resynchronize after damaged records rather than stopping (see salvage_record()) */
+	bool salvage;
+	size_t skipped_records, skipped_bytes;
+
+	/* schemas and events: noted for xref_check() as they are decoded, if set */
+	struct xref_seen *seen;
+
+	/* events only: checks already made of the whole section (see events_check()) */
+	const struct event_check *checks;
+	size_t nr_checks;
+};
+
+#define SECTION_WALK_INIT(sec, print_, o_) { .bytes = (sec).bytes, .count = (sec).entry_count, \
+	.keep = true, .print = (print_), .o = (o_) }
+
+/*
+ * Walk the complete records at the start of @buf (@len bytes), continuing
+ * from where @w left off. Returns the number of bytes of @buf that have been
+ * consumed; the rest has to be handed in again, with more after it.
+ */
+size_t walk_schemas(struct section_walk *w, struct catalog_model *m,
+		void *buf, size_t len, bool last);
+size_t walk_groups(struct section_walk *w, struct catalog_model *m,
+		void *buf, size_t len, bool last);
+size_t walk_events(struct section_walk *w, struct catalog_model *m,
+		void *buf, size_t len, bool last);
+
+/* Walk whatever records of section @id are complete in @buf */
+size_t walk_section(enum catalog_section_id id, struct section_walk *w,
+		struct catalog_model *m, void *buf, size_t len, bool last);
+
+/*
+ * Streaming: pages arrive in file order and are accumulated per section in
+ * a window just large enough to hold a page plus the largest record that
+ * could be straddling it. walk_stream_page() is the catalog_page_fn to hand
+ * catalog_stream() along with a struct walk_stream (zeroed, then with its
+ * walks and model set up). Free the windows once streaming is over.
+ */
+struct walk_stream {
+	struct catalog_window win[CATALOG_SECTION_COUNT];
+	struct section_walk walk[CATALOG_SECTION_COUNT];
+	struct catalog_model *m;
+};
+
+int walk_stream_page(void *priv, enum catalog_section_id id, void *page, bool last);
+
+/*
+ * Walk section @id, which starts at @page of @fd, through @win: top it up
+ * with pread() and consume the records walked until the section is done.
+ */
+int walk_windowed(int fd, enum catalog_section_id id, unsigned page,
+		struct section_walk *w, struct catalog_model *m, struct catalog_window *win);
+
+#endif